@@ -0,0 +1,141 @@
+#include <chrono>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "reclaim.h"
+#include "slabAllocator.h"
+#include "lockFreeQueue.h"
+
+// 对照组, 直接使用 glibc malloc
+struct MallocAllocator {
+  static void* Allocate(size_t size) { return std::malloc(size); }
+
+  static void Deallocate(void *ptr, size_t size) { std::free(ptr); }
+};
+
+using Slab = lockFree::SlabAllocator<>;
+
+/*
+ * 每个线程在自己的块中写入线程编号, 释放前检查没有被其他线程改写, 一半的块交给下一个线程释放
+ */
+void basic_test(size_t threads, int rounds) {
+  std::vector<std::vector<void*>> handoff(threads);
+  std::vector<std::thread> workers;
+  for (size_t id = 0; id < threads; id++) {
+    workers.emplace_back([id, rounds, &handoff]() {
+      std::vector<std::pair<void*, size_t>> blocks;
+      for (int round = 0; round < rounds; round++) {
+        for (size_t size = 1; size <= 320; size += 7) {
+          auto *ptr = Slab::Allocate(size);
+          memset(ptr, static_cast<int>(id), size);
+          blocks.emplace_back(ptr, size);
+        }
+        for (auto [ptr, size] : blocks) {
+          auto *bytes = static_cast<unsigned char*>(ptr);
+          for (size_t i = 0; i < size; i++) {
+            assert(bytes[i] == static_cast<unsigned char>(id));
+          }
+          Slab::Deallocate(ptr, size);
+        }
+        blocks.clear();
+      }
+      for (int i = 0; i < 1000; i++) {
+        handoff[id].push_back(Slab::Allocate(48));
+      }
+    });
+  }
+  for (auto &it : workers) {
+    it.join();
+  }
+  // 由其他线程分配的块在主线程释放
+  for (auto &it : handoff) {
+    for (auto *ptr : it) {
+      Slab::Deallocate(ptr, 48);
+    }
+  }
+  std::cout << "Slab bytes " << Slab::SlabBytes() << "\n";
+}
+
+/*
+ * 每个线程每轮分配 batch 个 size 字节的块再全部释放, 统计每秒完成的分配次数
+ */
+template<typename A>
+void allocate_benchmark(const char *name, size_t threads, size_t size, size_t batch, int rounds) {
+  std::vector<std::thread> workers;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back([size, batch, rounds]() {
+      std::vector<void*> blocks(batch);
+      for (int round = 0; round < rounds; round++) {
+        for (auto &it : blocks) {
+          it = A::Allocate(size);
+        }
+        for (auto *it : blocks) {
+          A::Deallocate(it, size);
+        }
+      }
+    });
+  }
+  for (auto &it : workers) {
+    it.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+  double total = static_cast<double>(threads * batch) * rounds;
+  printf("%6s, Threads(%2lu), Size(%3lu), Time(%6lld ms), %8.2f Mops/s\n", name, threads, size,
+         static_cast<int64_t>(ms), total / 1000.0 / std::max<int64_t>(ms, 1));
+}
+
+/*
+ * 一半线程入队一半线程出队, 出队的节点由回收器释放, 使用 slab 时释放的节点回到出队线程的弹匣
+ */
+template<typename A>
+void queue_benchmark(const char *name, size_t threads, int limit) {
+  lockFree::LockFreeQueue<int, lockFree::Reclaimer, A> q(std::make_shared<lockFree::HazardDomain>());
+  size_t producer = std::max<size_t>(threads / 2, 1);
+  std::vector<std::thread> workers;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < producer; i++) {
+    workers.emplace_back([&q, limit]() {
+      for (int i = 0; i < limit; i++) {
+        q.Push(i);
+      }
+    });
+    workers.emplace_back([&q, limit]() {
+      int value;
+      for (int i = 0; i < limit; i++) {
+        while (!q.Pop(value));
+      }
+    });
+  }
+  for (auto &it : workers) {
+    it.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+  printf("%6s queue, Threads(%2lu), Time(%6lld ms)\n", name, producer * 2,
+         static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()));
+}
+
+void benchmark_test() {
+  for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+    for (size_t size : {16, 64, 256}) {
+      allocate_benchmark<MallocAllocator>("Malloc", threads, size, 256, 20000 / static_cast<int>(threads));
+      allocate_benchmark<Slab>("Slab", threads, size, 256, 20000 / static_cast<int>(threads));
+    }
+  }
+  for (size_t threads : {2, 4, 8, 16, 32}) {
+    queue_benchmark<lockFree::NewAllocator>("New", threads, 2000000 / static_cast<int>(threads));
+    queue_benchmark<Slab>("Slab", threads, 2000000 / static_cast<int>(threads));
+  }
+  std::cout << "Slab bytes " << Slab::SlabBytes() << "\n";
+}
+
+int main() {
+//  basic_test(8, 100);
+  benchmark_test();
+  return 0;
+}
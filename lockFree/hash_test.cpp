@@ -200,6 +200,7 @@ void MultiInsert(size_t ins) {
   }
 }
 
+template<typename R = lockFree::Reclaimer>
 void Multi(size_t ins, size_t del, size_t fd) {
   std::cout << "Multi: " << " (" << ins << ", " << del << ", " << fd << ")\n";
   size_t base = std::max(ins, 1ul) * std::max(del, 1ul) * std::max(fd, 1ul);
@@ -229,7 +230,7 @@ void Multi(size_t ins, size_t del, size_t fd) {
     assert(it.second == 1);
   }
 
-  auto hashTable = lockFree::LockFreeHashTable<std::string, std::string>();
+  auto hashTable = lockFree::LockFreeHashTable<std::string, std::string, R>();
 
   std::cout << "Begin ----------\n";
 //  for (const auto &it : pairs) {
@@ -261,6 +262,7 @@ void Multi(size_t ins, size_t del, size_t fd) {
       }
     }, limit / del * i, limit / del * (i + 1));
   }
+  // 偶数下标的 key 会被删除, 查找线程只等待不会被删除的奇数下标的 key
   for (int i = 0; i < fd; i++) {
     find_threads.emplace_back([&hashTable, &pairs](int l, int r) {
       std::string value;
@@ -268,6 +270,9 @@ void Multi(size_t ins, size_t del, size_t fd) {
 //        if (i % 100 == 0) {
 //          std::cout << "Find: " << i << "\n";
 //        }
+        if (!(i & 1)) {
+          continue ;
+        }
         while (!hashTable.Find(pairs[i].first, value));
         assert(value == pairs[i].second);
       }
@@ -282,25 +287,31 @@ void Multi(size_t ins, size_t del, size_t fd) {
   for (auto &it : insert_threads) {
     it.join();
   }
-  assert(hashTable.Size() == limit);
   std::cout << "Insert OK\n";
+  // 删除线程全部结束之后, 偶数下标的 key 都已经删除
   for (auto &it : delete_threads) {
     it.join();
   }
+  assert(hashTable.Size() == limit / 2);
   for (auto &it : find_threads) {
     it.join();
   }
+  std::string value;
+  for (int i = 0; i < limit; i++) {
+    assert(hashTable.Find(pairs[i].first, value) == static_cast<bool>(i & 1));
+  }
 
   std::cout << "ALLDONE\n";
   //  print_thread.join();
 }
 
+template<typename R = lockFree::Reclaimer>
 void MultiInsertBenchmarkLockFree(size_t ins, size_t limit,
                                   const std::vector<std::pair<std::string, std::string>> &inserts) {
   limit = limit / ins * ins;
 
   std::vector<std::thread> insert_threads;
-  auto hashTable = lockFree::LockFreeHashTable<std::string, std::string>();
+  auto hashTable = lockFree::LockFreeHashTable<std::string, std::string, R>();
 
   for (int i = 0; i < ins; i++) {
     insert_threads.emplace_back([&hashTable, &inserts](int l, int r) {
@@ -337,6 +348,83 @@ void MultiInsertBenchmarkBlock(size_t ins, size_t limit,
   assert(hashTable.Size() == limit);
 }
 
+/*
+ * Find 为主的混合负载, 每 find_per_update 次 Find 之后 Delete 并重新 Insert 一个 key,
+ * 用于比较 hazard 发布时 Symmetric 和 Asymmetric 两种 fence 模式
+ */
+void FindHeavyBenchmark(lockFree::HazardFence fence, size_t threads, size_t find_per_update,
+                        const std::vector<std::pair<std::string, std::string>> &pairs) {
+  auto domain = std::make_shared<lockFree::HazardDomain>(fence);
+  auto hashTable = lockFree::LockFreeHashTable<std::string, std::string>(domain);
+  for (const auto &it : pairs) {
+    hashTable.Insert(it.first, it.second);
+  }
+
+  size_t limit = pairs.size() / threads * threads;
+  std::vector<std::thread> find_threads;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < threads; i++) {
+    find_threads.emplace_back([&hashTable, &pairs, find_per_update](size_t l, size_t r) {
+      std::string value;
+      for (size_t rep = 0; rep < 4; rep++) {
+        for (size_t i = l; i < r; i++) {
+          if (i % (find_per_update + 1) == 0) {
+            hashTable.Delete(pairs[i].first);
+            hashTable.Insert(pairs[i].first, pairs[i].second);
+          } else {
+            hashTable.Find(pairs[i].first, value);
+          }
+        }
+      }
+    }, limit / threads * i, limit / threads * (i + 1));
+  }
+  for (auto &it : find_threads) {
+    it.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  printf("%s, Thread(%2lu), Find/Update(%4lu), %5lld ms\n",
+         domain->Fence() == lockFree::HazardFence::Asymmetric ? "Asymmetric" : " Symmetric", threads, find_per_update,
+         static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()));
+}
+
+uint64_t SplitMix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/*
+ * 逐步插入 limit 个随机的 64 位 key, 在每个检查点输出 bucket 数, 平均链长 (Size / BucketSize) 和随机 Find 的平均耗时,
+ * bucket 数随元素个数翻倍, 平均链长保持在 1 / LoadFactor 以内
+ */
+void ChainLengthBenchmark(size_t limit) {
+  auto hashTable = lockFree::LockFreeHashTable<uint64_t, uint64_t, lockFree::Reclaimer, lockFree::SlabAllocator<>>();
+  std::mt19937_64 generator(1);
+  size_t inserted = 0;
+  for (size_t checkpoint : {1000000, 10000000, 50000000, 100000000}) {
+    if (checkpoint > limit) {
+      break;
+    }
+    for (; inserted < checkpoint; inserted++) {
+      hashTable.Insert(SplitMix64(inserted), inserted);
+    }
+    size_t finds = 1000000;
+    uint64_t value;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < finds; i++) {
+      auto index = generator() % inserted;
+      hashTable.Find(SplitMix64(index), value);
+      assert(value == index);
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("Keys(%9lu), Buckets(%9lu), Chain(%5.2f), Find(%4lld ns)\n", hashTable.Size(), hashTable.BucketSize(),
+           static_cast<double>(hashTable.Size()) / static_cast<double>(hashTable.BucketSize()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / finds));
+  }
+}
+
 int main() {
   std::srand(static_cast<unsigned int>(std::time(nullptr)));
 //  InsertFindDeleteTest();
@@ -360,16 +448,36 @@ int main() {
 //  for (size_t ins = 1; ins <= 20; ins++) {
 //    printf("Thread(%2lu), ", ins);
 //    auto begin_lock_free = std::chrono::steady_clock::now();
-//    MultiInsertBenchmarkLockFree(ins, limit, inserts);
+//    MultiInsertBenchmarkLockFree<lockFree::Reclaimer>(ins, limit, inserts);
 //    auto end_lock_free = std::chrono::steady_clock::now();
 //
+//    auto begin_epoch = std::chrono::steady_clock::now();
+//    MultiInsertBenchmarkLockFree<lockFree::EpochReclaimer>(ins, limit, inserts);
+//    auto end_epoch = std::chrono::steady_clock::now();
+//
+//    auto begin_era = std::chrono::steady_clock::now();
+//    MultiInsertBenchmarkLockFree<lockFree::EraReclaimer>(ins, limit, inserts);
+//    auto end_era = std::chrono::steady_clock::now();
+//
 //    auto begin_block = std::chrono::steady_clock::now();
 //    MultiInsertBenchmarkBlock(ins, limit, inserts);
 //    auto end_block = std::chrono::steady_clock::now();
 //
-//    printf("LockFree(%5lld ms), Block(%5lld ms)\n",
+//    printf("LockFree(%5lld ms), Epoch(%5lld ms), Era(%5lld ms), Block(%5lld ms)\n",
 //           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+//           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch - begin_epoch).count()),
+//           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_era - begin_era).count()),
 //           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
+//  }
+//  std::vector<std::pair<std::string, std::string>> pairs;
+//  for (size_t i = 0; i < 1000000; i++) {
+//    pairs.emplace_back(generateRandomString() + std::to_string(i), generateRandomString());
+//  }
+//  for (size_t threads : {1, 2, 4, 8}) {
+//    for (size_t find_per_update : {10, 100, 1000}) {
+//      FindHeavyBenchmark(lockFree::HazardFence::Symmetric, threads, find_per_update, pairs);
+//      FindHeavyBenchmark(lockFree::HazardFence::Asymmetric, threads, find_per_update, pairs);
+//    }
 //  }
   // insert delete, find
   for (size_t ins = 1; ins <= 10; ins++) {
@@ -380,5 +488,6 @@ int main() {
     }
   }
 //  Multi(1, 3, 2);
+//  ChainLengthBenchmark(100000000);
   return 0;
 }
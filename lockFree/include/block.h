@@ -4,6 +4,8 @@
 #include <mutex>
 #include <queue>
 #include <stack>
+#include <vector>
+#include <functional>
 #include <unordered_map>
 
 namespace block {
@@ -80,6 +82,60 @@ class BlockStack {
   std::queue<T> q_;
 };
 
+/*
+ * 互斥锁保护的二叉堆, 优先级最小的元素先出队
+ */
+template<typename K, typename V, typename Compare = std::less<K>>
+class BlockPriorityQueue {
+ public:
+  BlockPriorityQueue() = default;
+  ~ BlockPriorityQueue() = default;
+
+  BlockPriorityQueue(const BlockPriorityQueue &other) = delete;
+  BlockPriorityQueue(BlockPriorityQueue &&other) = delete;
+  BlockPriorityQueue& operator = (const BlockPriorityQueue &other) = delete;
+  BlockPriorityQueue& operator = (BlockPriorityQueue &&other) = delete;
+
+  void Push(const K &priority, const V &value) { Emplace(priority, value); }
+
+  void Push(const K &priority, V &&value) { Emplace(priority, std::move(value)); }
+
+  bool Pop(K &priority, V &value) {
+    std::unique_lock lock(mu_);
+    if (q_.empty()) {
+      return false;
+    }
+    priority = q_.top().first;
+    value = q_.top().second;
+    q_.pop();
+    return true;
+  }
+
+  size_t Size() {
+    std::unique_lock lock(mu_);
+    return q_.size();
+  }
+
+ private:
+  using Item = std::pair<K, V>;
+
+  // std::priority_queue 是大顶堆, 比较方向取反
+  struct Greater {
+    bool operator () (const Item &a, const Item &b) const {
+      return Compare()(b.first, a.first);
+    }
+  };
+
+  template<typename Arg>
+  void Emplace(const K &priority, Arg &&value) {
+    std::unique_lock lock(mu_);
+    q_.emplace(priority, std::forward<Arg>(value));
+  }
+
+  std::mutex mu_;
+  std::priority_queue<Item, std::vector<Item>, Greater> q_;
+};
+
 template<typename K, typename V>
 class BlockHashMap {
  public:
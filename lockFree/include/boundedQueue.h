@@ -0,0 +1,136 @@
+#ifndef BOUNDEDQUEUE_H_
+#define BOUNDEDQUEUE_H_
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include "reclaim.h"
+
+namespace lockFree {
+
+/*
+ * 有界 MPMC 环形队列 (Vyukov), 容量向上取整为 2 的幂, 构造之后不再分配内存, 也不需要回收节点
+ * 每个槽有一个序号 sequence_, 位置 pos 的槽:
+ *   sequence_ == pos          空槽, 等待第 pos 次入队
+ *   sequence_ == pos + 1      已写入, 等待第 pos 次出队
+ *   sequence_ == pos + 容量    已取出, 等待下一圈入队
+ * 入队和出队先用 CAS 抢占 tail_ / head_ 上的位置, 再通过槽的序号交接元素
+ * 元素的构造和移动赋值不应抛出异常, 否则抢到的槽不会再被释放
+ */
+template<typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+      : mask_(RoundUp(capacity) - 1), slots_(new Slot[mask_ + 1]), head_(0), tail_(0) {
+    for (size_t i = 0; i <= mask_; i++) {
+      slots_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~ BoundedQueue() {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+      slots_[head & mask_].Get().~T();
+    }
+  }
+
+  bool TryPush(const T &data) { return TryEmplace(data); }
+
+  bool TryPush(T &&data) { return TryEmplace(std::move(data)); }
+
+  // 队列满时返回 false
+  template<typename ...Args>
+  bool TryEmplace(Args &&...args);
+
+  // 队列空时返回 false
+  bool TryPop(T &data);
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  // 并发修改时只是近似值
+  size_t Size() {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  BoundedQueue(const BoundedQueue &other) = delete;
+  BoundedQueue(BoundedQueue &&other) = delete;
+  BoundedQueue& operator = (const BoundedQueue &other) = delete;
+  BoundedQueue& operator = (BoundedQueue &&other) = delete;
+
+ private:
+  struct Slot {
+    T& Get() { return *std::launder(reinterpret_cast<T*>(storage_)); }
+
+    std::atomic<size_t> sequence_;
+    alignas(T) unsigned char storage_[sizeof(T)];
+  };
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  // 入队和出队的线程分别只修改 tail_ 和 head_, 放在不同的缓存行中
+  alignas(CacheLineSize) std::atomic<size_t> head_;
+  alignas(CacheLineSize) std::atomic<size_t> tail_;
+};
+
+template<typename T> template<typename ...Args>
+bool BoundedQueue<T>::TryEmplace(Args &&...args) {
+  auto pos = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    auto &slot = slots_[pos & mask_];
+    auto sequence = slot.sequence_.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        new (slot.storage_) T(std::forward<Args>(args)...);
+        slot.sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // 上一圈的元素还没有被取出
+      return false;
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template<typename T>
+bool BoundedQueue<T>::TryPop(T &data) {
+  auto pos = head_.load(std::memory_order_relaxed);
+  for (;;) {
+    auto &slot = slots_[pos & mask_];
+    auto sequence = slot.sequence_.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        data = std::move(slot.Get());
+        slot.Get().~T();
+        slot.sequence_.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // 这一圈的元素还没有写入
+      return false;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef ELIMINATIONSTACK_H_
+#define ELIMINATIONSTACK_H_
+
+#include "lockFreeStack.h"
+
+namespace lockFree {
+
+constexpr size_t EliminationMaxWidth = 16;
+
+constexpr int EliminationSpin = 64;
+
+/*
+ * 在 LockFreeStack 前面加一层消除数组 (elimination backoff)
+ * front_ 上 CAS 失败的 Push 把节点挂到随机的一个槽中等待一小段时间, CAS 失败的 Pop 到随机的槽中取节点,
+ * 配对成功的 Push 和 Pop 直接交换节点, 不再访问 front_; 没有配对则回到栈上重试
+ * 使用的槽数 width_ 随竞争自适应: 槽被占用时变宽, 等不到配对时变窄
+ * 私有继承 LockFreeStack, Push / Pop 不是虚函数, 不能通过 LockFreeStack 的引用绕过消除数组;
+ * PushBulk / PopBulk 直接操作栈, 不经过消除数组, 消除的节点从未进入栈中, 两者可以混用
+ */
+template<typename T, typename R = Reclaimer, typename A = NewAllocator>
+class EliminationStack : private LockFreeStack<T, R, A> {
+  using Base = LockFreeStack<T, R, A>;
+  using Data = typename Base::Data;
+  using Point = typename Base::Point;
+  using Guard = typename Base::Guard;
+  using PopResult = typename Base::PopResult;
+ public:
+  using Domain = typename R::Domain;
+
+  EliminationStack() : Base() {}
+
+  explicit EliminationStack(std::shared_ptr<Domain> domain) : Base(std::move(domain)) {}
+
+  ~ EliminationStack() = default;
+
+  void Push(const T &data) { Emplace(data); }
+
+  void Push(T &&data) { Emplace(std::move(data)); }
+
+  bool Pop(T &data);
+
+  // 与 LockFreeStack 相同, 但每次尝试都经过消除数组
+  void PopWait(T &data) {
+    WaitUntil(this->not_empty_, [this, &data]() { return Pop(data); });
+  }
+
+  template<typename Rep, typename Period>
+  bool PopWaitFor(T &data, const std::chrono::duration<Rep, Period> &timeout) {
+    return WaitUntilFor(this->not_empty_, [this, &data]() { return Pop(data); }, timeout);
+  }
+
+  using Base::PushBulk;
+  using Base::PopBulk;
+  using Base::Size;
+  using Base::Global_Size;
+  using Base::DefaultDomain;
+  using Base::GetDomain;
+
+  size_t Width() { return width_.load(std::memory_order_relaxed); }
+
+  EliminationStack(const EliminationStack &other) = delete;
+  EliminationStack(EliminationStack &&other) = delete;
+  EliminationStack& operator = (const EliminationStack &other) = delete;
+  EliminationStack& operator = (EliminationStack &&other) = delete;
+
+ private:
+  struct alignas(CacheLineSize) Slot {
+    std::atomic<Data*> node_{nullptr};
+  };
+
+  template<typename Arg>
+  void Emplace(Arg &&arg);
+
+  bool TryEliminatePush(Data *node);
+
+  Data* TryEliminatePop();
+
+  Slot& RandomSlot();
+
+  void Grow(size_t width);
+
+  void Shrink(size_t width);
+
+
+  Slot slots_[EliminationMaxWidth];
+  std::atomic<size_t> width_{1};
+};
+
+template<typename T, typename R, typename A> template<typename Arg>
+void EliminationStack<T, R, A>::Emplace(Arg &&arg) {
+  auto *node = this->NewNode(std::forward<Arg>(arg));
+  this->size_.fetch_add(1, std::memory_order_acq_rel);
+  while (!this->TryPush(node, node) && !TryEliminatePush(node));
+  this->not_empty_.Notify();
+}
+
+template<typename T, typename R, typename A>
+bool EliminationStack<T, R, A>::Pop(T &data) {
+  auto &reclaimer = this->GetReclaimer();
+  Guard guard(reclaimer);
+  Point hp;
+  Data *front;
+  for (;;) {
+    auto result = this->TryPop(hp, &front);
+    if (result == PopResult::Success) {
+      break;
+    }
+    if (result == PopResult::Empty) {
+      return false;
+    }
+    // 消除得到的节点从未进入栈中, 其他线程不会再访问, 可以直接删除
+    if (auto *node = TryEliminatePop(); node != nullptr) {
+      this->size_.fetch_sub(1, std::memory_order_acq_rel);
+      data = std::move(node->value_.Get());
+      delete node;
+      return true;
+    }
+  }
+  this->FinishPop(reclaimer, front, data);
+  return true;
+}
+
+/*
+ * 槽中的节点只会被 Pop 取走或者被自己收回, 所以槽不再等于 node 说明已经被取走
+ * 节点被取走释放后地址可能被另一个 Push 复用并挂到同一个槽中, 此时收回的是对方的节点,
+ * 自己随后把它压入栈中, 对方则认为已经被取走, 每个节点仍然恰好交付一次
+ */
+template<typename T, typename R, typename A>
+bool EliminationStack<T, R, A>::TryEliminatePush(Data *node) {
+  auto width = width_.load(std::memory_order_relaxed);
+  auto &slot = RandomSlot();
+  Data *expected = nullptr;
+  if (!slot.node_.compare_exchange_strong(expected, node, std::memory_order_release, std::memory_order_relaxed)) {
+    Grow(width);
+    return false;
+  }
+  for (int i = 0; i < EliminationSpin; i++) {
+    if (slot.node_.load(std::memory_order_acquire) != node) {
+      return true;
+    }
+  }
+  expected = node;
+  if (slot.node_.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel, std::memory_order_acquire)) {
+    Shrink(width);
+    return false;
+  }
+  return true;
+}
+
+// 只比较指针, 不访问槽中的节点, CAS 成功时节点一定是某个 Push 正在等待配对的节点
+template<typename T, typename R, typename A>
+EliminationStack<T, R, A>::Data* EliminationStack<T, R, A>::TryEliminatePop() {
+  auto width = width_.load(std::memory_order_relaxed);
+  auto &slot = RandomSlot();
+  for (int i = 0; i < EliminationSpin; i++) {
+    auto *node = slot.node_.load(std::memory_order_acquire);
+    if (node == nullptr) {
+      continue;
+    }
+    if (slot.node_.compare_exchange_strong(node, nullptr, std::memory_order_acquire, std::memory_order_relaxed)) {
+      return node;
+    }
+    Grow(width);
+    return nullptr;
+  }
+  Shrink(width);
+  return nullptr;
+}
+
+template<typename T, typename R, typename A>
+EliminationStack<T, R, A>::Slot& EliminationStack<T, R, A>::RandomSlot() {
+  // xorshift, 每个线程独立的种子
+  thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return slots_[seed % width_.load(std::memory_order_relaxed)];
+}
+
+template<typename T, typename R, typename A>
+void EliminationStack<T, R, A>::Grow(size_t width) {
+  if (width < EliminationMaxWidth) {
+    width_.compare_exchange_weak(width, width + 1, std::memory_order_relaxed);
+  }
+}
+
+template<typename T, typename R, typename A>
+void EliminationStack<T, R, A>::Shrink(size_t width) {
+  if (width > 1) {
+    width_.compare_exchange_weak(width, width - 1, std::memory_order_relaxed);
+  }
+}
+
+}
+
+#endif
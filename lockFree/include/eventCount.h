@@ -0,0 +1,157 @@
+#ifndef EVENTCOUNT_H_
+#define EVENTCOUNT_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace lockFree {
+
+constexpr int EventSpin = 128;
+
+/*
+ * 基于 futex 的 eventcount, 让无锁容器的消费者在容器为空时睡眠
+ * state_ 高 32 位为 epoch, 低 32 位为正在等待的线程数, futex 等待在 epoch 所在的 32 位上
+ * 等待方: PrepareWait 登记后再检查一次条件, 条件满足则 CancelWait, 否则 Wait 直到 epoch 变化
+ * 通知方: 修改容器之后 Notify, 没有线程登记时只有一次 fence 和一次读, 不会进入系统调用
+ * 等待方登记的 RMW 和通知方的 fence 保证: 要么通知方看到登记, 要么等待方的再次检查看到修改
+ */
+class EventCount {
+ public:
+  using Key = uint32_t;
+
+  EventCount() : state_(0) {}
+  ~ EventCount() = default;
+
+  Key PrepareWait() {
+    return static_cast<Key>(state_.fetch_add(WaiterOne, std::memory_order_seq_cst) >> EpochShift);
+  }
+
+  void CancelWait() {
+    state_.fetch_sub(WaiterOne, std::memory_order_relaxed);
+  }
+
+  void Wait(Key key) {
+    while (Epoch() == key) {
+      Futex(FUTEX_WAIT_PRIVATE, key, nullptr);
+    }
+    state_.fetch_sub(WaiterOne, std::memory_order_relaxed);
+  }
+
+  // 超时返回 false
+  template<typename Rep, typename Period>
+  bool WaitFor(Key key, const std::chrono::duration<Rep, Period> &timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    bool notified = true;
+    while (Epoch() == key) {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        notified = false;
+        break;
+      }
+      auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+      timespec ts{static_cast<time_t>(left / 1000000000), static_cast<long>(left % 1000000000)};
+      Futex(FUTEX_WAIT_PRIVATE, key, &ts);
+    }
+    state_.fetch_sub(WaiterOne, std::memory_order_relaxed);
+    return notified;
+  }
+
+  void Notify() { Wake(1); }
+
+  void NotifyAll() { Wake(INT_MAX); }
+
+  EventCount(const EventCount &other) = delete;
+  EventCount(EventCount &&other) = delete;
+  EventCount& operator = (const EventCount &other) = delete;
+  EventCount& operator = (EventCount &&other) = delete;
+
+ private:
+  static constexpr uint64_t WaiterOne = 1;
+
+  static constexpr uint64_t WaiterMask = (uint64_t(1) << 32) - 1;
+
+  static constexpr int EpochShift = 32;
+
+  static constexpr uint64_t EpochOne = uint64_t(1) << EpochShift;
+
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "futex word is the high half of state_");
+
+  Key Epoch() const {
+    return static_cast<Key>(state_.load(std::memory_order_acquire) >> EpochShift);
+  }
+
+  void Wake(int count) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((state_.load(std::memory_order_relaxed) & WaiterMask) == 0) {
+      return ;
+    }
+    state_.fetch_add(EpochOne, std::memory_order_release);
+    Futex(FUTEX_WAKE_PRIVATE, count, nullptr);
+  }
+
+  long Futex(int op, uint32_t value, const timespec *timeout) {
+    auto *word = reinterpret_cast<uint32_t*>(&state_) + 1;
+    return syscall(SYS_futex, word, op, value, timeout, nullptr, 0);
+  }
+
+  std::atomic<uint64_t> state_;
+};
+
+/*
+ * 容器共用的等待出队逻辑, pop 为一次非阻塞的出队尝试: 先自旋一小段时间, 之后登记并睡眠
+ */
+template<typename Pop>
+void WaitUntil(EventCount &event, Pop &&pop) {
+  for (int i = 0; i < EventSpin; i++) {
+    if (pop()) {
+      return ;
+    }
+  }
+  for (;;) {
+    auto key = event.PrepareWait();
+    if (pop()) {
+      event.CancelWait();
+      return ;
+    }
+    event.Wait(key);
+    if (pop()) {
+      return ;
+    }
+  }
+}
+
+template<typename Pop, typename Rep, typename Period>
+bool WaitUntilFor(EventCount &event, Pop &&pop, const std::chrono::duration<Rep, Period> &timeout) {
+  for (int i = 0; i < EventSpin; i++) {
+    if (pop()) {
+      return true;
+    }
+  }
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;) {
+    auto key = event.PrepareWait();
+    if (pop()) {
+      event.CancelWait();
+      return true;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      event.CancelWait();
+      return false;
+    }
+    event.WaitFor(key, deadline - now);
+    if (pop()) {
+      return true;
+    }
+  }
+}
+
+}
+
+#endif
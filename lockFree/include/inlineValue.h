@@ -0,0 +1,72 @@
+#ifndef INLINEVALUE_H_
+#define INLINEVALUE_H_
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace lockFree {
+
+/*
+ * 节点内原地构造的元素, 入队只需要分配一次节点, 出队时不再需要经过 T* 的一次额外访存。
+ * 哨兵节点不持有元素, 一般类型需要记录是否已经构造, 析构时才知道要不要析构元素;
+ * trivially copyable 的类型析构为空操作, 不需要额外的标记, 也不需要析构
+ */
+template<typename T, bool Trivial = std::is_trivially_copyable_v<T>>
+class InlineValue {
+ public:
+  InlineValue() : constructed_(false) {}
+
+  ~ InlineValue() {
+    if (constructed_) {
+      Get().~T();
+    }
+  }
+
+  template<typename ...Args>
+  void Construct(Args &&...args) {
+    new (storage_) T(std::forward<Args>(args)...);
+    constructed_ = true;
+  }
+
+  T& Get() {
+    return *std::launder(reinterpret_cast<T*>(storage_));
+  }
+
+  InlineValue(const InlineValue &other) = delete;
+  InlineValue(InlineValue &&other) = delete;
+  InlineValue& operator = (const InlineValue &other) = delete;
+  InlineValue& operator = (InlineValue &&other) = delete;
+
+ private:
+  alignas(T) unsigned char storage_[sizeof(T)];
+  bool constructed_;
+};
+
+template<typename T>
+class InlineValue<T, true> {
+ public:
+  InlineValue() = default;
+  ~ InlineValue() = default;
+
+  template<typename ...Args>
+  void Construct(Args &&...args) {
+    new (storage_) T(std::forward<Args>(args)...);
+  }
+
+  T& Get() {
+    return *std::launder(reinterpret_cast<T*>(storage_));
+  }
+
+  InlineValue(const InlineValue &other) = delete;
+  InlineValue(InlineValue &&other) = delete;
+  InlineValue& operator = (const InlineValue &other) = delete;
+  InlineValue& operator = (InlineValue &&other) = delete;
+
+ private:
+  alignas(T) unsigned char storage_[sizeof(T)];
+};
+
+}
+
+#endif
@@ -3,81 +3,97 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#ifdef LOCKFREE_HUGE_PAGES
+#include <sys/mman.h>
+#endif
 
 #include "reclaim.h"
+#include "slabAllocator.h"
 
 namespace lockFree {
 
 /*
- * bucket的索引方式类似页表的查询, 最多四层(level 0 ~ 3) 最后一层是 bucket, 所以hash值只有后24位有用
- * level 0 | level 1 | level 2 | level 3 |
- * segment | segment | segment | bucket  |
+ * bucket 目录是一个扁平的数组, 下标即 bucket 编号, 查找 bucket 只需要一次 load
+ * 目录在堆上分配, 容量不足时复制出两倍大小的新目录并用 CAS 发布, 旧目录可能仍在被读取,
+ * 由新目录引用, 析构时一起释放; 复制之后才写入旧目录的 bucket 在新目录中为空,
+ * 再次初始化时会在链表中找到已有的 dummy 节点, 目录中的 bucket 只是链表的索引
+ * 定义 LOCKFREE_HUGE_PAGES 时目录改为用 mmap 一次预留 BucketMaxSize 个 bucket 的地址空间 (MAP_NORESERVE, 约 32 GiB),
+ * 只有访问到的页才占用内存, bucket_size_ 翻倍时目录不需要移动, 并建议内核使用透明大页;
+ * 每个哈希表都占用这么多地址空间, 在 RLIMIT_AS 或 overcommit_memory=2 下 mmap 会失败, 此时退回到堆上的目录
+ * hash 值保留低 63 位, 链表按 hash 的 64 位位反转排序 (split-ordered list), 最低位区分 dummy(0) 和 regular(1)
  */
 
-constexpr size_t MaxSegLevel = 2;
+constexpr double LoadFactor = 0.618;
 
-constexpr size_t BucketLevel = 3;
+constexpr size_t BucketMaxSize = size_t(1) << 32;
 
-constexpr size_t KSegMaxSize = 64;
+constexpr size_t DirectoryMinSize = size_t(1) << 10;
 
-constexpr double LoadFactor = 0.618;
+constexpr size_t HugePageSize = size_t(2) << 20;
 
-constexpr size_t BucketMaxSize = 1 << 24;
-
-#define HASH_LEVEL_INDEX(HASH, LEVEL) (((HASH) >> (((BucketLevel) - (LEVEL)) * 6)) & 0x3f)
-
-static const uint8_t reverseTable[256] = {
-    0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
-    0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
-    0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
-    0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
-    0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
-    0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
-    0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
-    0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
-    0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
-    0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
-    0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
-    0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
-    0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
-    0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
-    0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
-    0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
-};
+constexpr size_t HashMask = ~size_t(0) >> 1;
 
-size_t ReverseBit24(size_t num) {
-  return (reverseTable[num & 0xFF] << 16) | (reverseTable[(num >> 8) & 0xFF] << 8) | reverseTable[(num >> 16) & 0xFF];
+// 相邻位, 相邻两位, 相邻四位依次交换, 最后用 bswap 反转字节顺序
+constexpr uint64_t ReverseBit64(uint64_t num) {
+  num = ((num >> 1) & 0x5555555555555555ULL) | ((num & 0x5555555555555555ULL) << 1);
+  num = ((num >> 2) & 0x3333333333333333ULL) | ((num & 0x3333333333333333ULL) << 2);
+  num = ((num >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((num & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return __builtin_bswap64(num);
 }
 
-template <typename K, typename V>
-class HashTableReclaimer;
+static_assert(ReverseBit64(1) == (uint64_t(1) << 63));
+static_assert(ReverseBit64(0x00000000000000F1ULL) == 0x8F00000000000000ULL);
 
-template <typename K, typename V>
+/*
+ * R 为回收策略, 可选 Reclaimer(hazard pointer), EpochReclaimer(epoch-based reclamation)
+ * 或 EraReclaimer(hazard eras), 节点继承 R::NodeBase
+ * A 为节点和值的分配器策略, 默认 NewAllocator, 可选 SlabAllocator<>, 回收器释放的节点和值同样回到 A
+ * 不指定 domain 时使用同类型哈希表共享的默认 domain
+ */
+template <typename K, typename V, typename R = Reclaimer, typename A = NewAllocator>
 class LockFreeHashTable {
   struct Dummy;
   using Hash = std::hash<K>;
   using Bucket = std::atomic<Dummy*>;
+  using Point = typename R::Point;
+  using Guard = typename R::Guard;
  public:
-  LockFreeHashTable() : hash_func_(Hash()), size_(0), bucket_size_(2) {
-    auto *segments = segments_;
-    // 0 | 1 | 2
-    for (size_t level = 1; level <= MaxSegLevel; level++) {
-      auto *new_segments = NewSegments(level);
-      segments[0].data_.store(new_segments, std::memory_order_release);
-      segments = new_segments;
-    }
-    // 当前持有第 2 层的segments
-    auto *buckets = NewBuckets();
-    segments[0].data_.store(buckets, std::memory_order_release);
+  using Domain = typename R::Domain;
 
+  LockFreeHashTable() : LockFreeHashTable(DefaultDomain()) {}
+
+  explicit LockFreeHashTable(std::shared_ptr<Domain> domain)
+      : domain_(std::move(domain)), hash_func_(Hash()), size_(0), bucket_size_(2) {
+    Directory *directory = nullptr;
+#ifdef LOCKFREE_HUGE_PAGES
+    directory = NewDirectory(BucketMaxSize, nullptr, true);
+#endif
+    if (directory == nullptr) {
+      directory = NewDirectory(DirectoryMinSize, nullptr, false);
+    }
     auto *head = new Dummy(0);
-    buckets[0].store(head, std::memory_order_release);
+    directory->Buckets()[0].store(head, std::memory_order_release);
+    directory_.store(directory, std::memory_order_release);
     head_ = head;
   }
 
+  // 析构时不能再有其他线程访问, 链表中剩下的节点和所有目录在这里释放
   ~ LockFreeHashTable() {
-    // TODO
-    // std::cout << "~ LockFreeHashTable()\n";
+    Node *node = head_;
+    while (node != nullptr) {
+      auto *next = Unmarked(node->next_.load(std::memory_order_acquire));
+      delete node;
+      node = next;
+    }
+    auto *directory = directory_.load(std::memory_order_acquire);
+    while (directory != nullptr) {
+      auto *previous = directory->previous_;
+      FreeDirectory(directory);
+      directory = previous;
+    }
   }
 
   LockFreeHashTable(const LockFreeHashTable &other) = delete;
@@ -111,49 +127,41 @@ class LockFreeHashTable {
 
   size_t Size() { return size_.load(std::memory_order_acquire); }
 
+  // 当前的 bucket 数, Size() / BucketSize() 为平均链长
+  size_t BucketSize() { return bucket_size_.load(std::memory_order_acquire); }
+
   void DebugPrint();
 
- private:
-  friend HashTableReclaimer<K, V>;
+  static std::shared_ptr<Domain> DefaultDomain() {
+    static auto domain = std::make_shared<Domain>();
+    return domain;
+  }
 
-  struct Segment {
-    Segment() : level_(0), data_(nullptr) {}
+  const std::shared_ptr<Domain>& GetDomain() const {
+    return domain_;
+  }
 
-    explicit Segment(size_t level) : level_(level), data_(nullptr) {}
+ private:
+  // bucket 数组紧跟在头部之后, 整块内存一次分配
+  struct Directory {
+    Directory(size_t capacity, Directory *previous, bool mapped)
+        : capacity_(capacity), previous_(previous), mapped_(mapped) {}
 
-    ~ Segment() {
-//      // std::cout << "OK\n";
-      void *ptr = data_.load(std::memory_order_acquire);
-      if (ptr == nullptr) {
-        return;
-      }
-//      // std::cout << "OK\n";
-
-//      // std::cout << "~ Segment() in\n";
-      if (level_ < MaxSegLevel) {
-//        // std::cout << "Segment in\n";
-        auto *segment = static_cast<Segment *>(ptr);
-        delete[] segment;
-//        // std::cout << "Segment ou\n";
-      } else {
-//        // std::cout << "Bucket in\n";
-        auto *buckets = static_cast<Bucket *>(ptr);
-//        // std::cout << "Bucket ou\n";
-        delete[] buckets;
-      }
-//      // std::cout << "~ Segment() ou\n";
-    }
+    Bucket* Buckets() { return reinterpret_cast<Bucket*>(this + 1); }
+
+    static size_t Bytes(size_t capacity) { return sizeof(Directory) + capacity * sizeof(Bucket); }
 
-    Segment(const Segment &other) = delete;
-    Segment(Segment &&other) = delete;
-    Segment &operator=(const Segment &other) = delete;
-    Segment &operator=(Segment &&other) = delete;
+    Directory(const Directory &other) = delete;
+    Directory(Directory &&other) = delete;
+    Directory &operator=(const Directory &other) = delete;
+    Directory &operator=(Directory &&other) = delete;
 
-    size_t level_;
-    std::atomic<void *> data_;
+    const size_t capacity_;
+    Directory *const previous_;
+    const bool mapped_;
   };
 
-  struct Node {
+  struct Node : public R::NodeBase, public AllocatedBy<A> {
     Node(size_t hash, bool is_dummy)
         : hash_(hash), order_key_(is_dummy ? DummyKey(hash) : RegularKey(hash)) {}
 
@@ -165,9 +173,10 @@ class LockFreeHashTable {
     Node& operator = (const Node &other) = delete;
     Node& operator = (Node &&other) = delete;
 
-    size_t DummyKey(size_t hash) { return (ReverseBit24(hash) << 1); }
+    // hash 只有低 63 位, 反转后最低位为 0
+    size_t DummyKey(size_t hash) { return ReverseBit64(hash); }
 
-    size_t RegularKey(size_t hash) { return ((ReverseBit24(hash) << 1) | 1); }
+    size_t RegularKey(size_t hash) { return ReverseBit64(hash) | 1; }
 
     bool IsDummy() { return (order_key_ & 1) == 0; }
 
@@ -178,20 +187,19 @@ class LockFreeHashTable {
 
   struct Regular : public Node {
     Regular(const K &key, const V &value, size_t hash)
-        : Node(hash, false), key_(key), value_(new V(value)) {}
+        : Node(hash, false), key_(key), value_(NewWith<V, A>(value)) {}
     Regular(const K &key, V &&value, size_t hash)
-        : Node(hash, false), key_(key), value_(new V(std::move(value))) {}
+        : Node(hash, false), key_(key), value_(NewWith<V, A>(std::move(value))) {}
     Regular(K &&key, const V &value, size_t hash)
-        : Node(hash, false), key_(std::move(key)), value_(new V(value)) {}
+        : Node(hash, false), key_(std::move(key)), value_(NewWith<V, A>(value)) {}
     Regular(K &&key, V &&value, size_t hash)
-        : Node(hash, false), key_(std::move(key)), value_(new V(std::move(value))) {}
+        : Node(hash, false), key_(std::move(key)), value_(NewWith<V, A>(std::move(value))) {}
 
     Regular(const K &key, size_t hash)
         : Node(hash, false), key_(key) {};
 
     ~ Regular() override {
-      auto *value = value_.load(std::memory_order_acquire);
-      delete value;
+      DeleteWith<V, A>(value_.load(std::memory_order_acquire), 0);
     }
 
     Regular() = delete;
@@ -215,14 +223,12 @@ class LockFreeHashTable {
     Dummy& operator = (Dummy &&other) = delete;
   };
 
-  size_t GetHash(const K &key) { return (hash_func_(key) & (0xffffff)); }
+  size_t GetHash(const K &key) { return (hash_func_(key) & HashMask); }
 
-  size_t GetParentIndex(size_t index) { return (index & (~(1 << (31 - __builtin_clz(index))))); }
-
-  static void DeleteNode(void* ptr) { delete static_cast<Node*>(ptr); }
+  size_t GetParentIndex(size_t index) { return (index & (~(size_t(1) << (63 - __builtin_clzll(index))))); }
 
   Node* Marked(Node *ptr) {
-    return reinterpret_cast<Node*>(reinterpret_cast<uint64_t>(ptr) & (0x1));
+    return reinterpret_cast<Node*>(reinterpret_cast<uint64_t>(ptr) | (0x1));
   }
 
   Node* Unmarked(Node *ptr) {
@@ -257,16 +263,22 @@ class LockFreeHashTable {
 
   Dummy* InitializeBucket(size_t index);
 
-  Bucket* NewBuckets();
+  void ReserveBuckets(size_t size);
+
+  static Directory* NewDirectory(size_t capacity, Directory *previous, bool mapped);
 
-  Segment* NewSegments(int level);
+  static void FreeDirectory(Directory *directory);
 
   bool InsertDummy(Dummy *parent_head, Dummy *head, Dummy **maybe_head);
 
   bool InsertRegular(Regular *insert_node);
 
   bool SearchNode(Dummy* head, Node* search_node, Node** prev_ptr,
-                  Node** cur_ptr, HazardPoint &prev_hp, HazardPoint &cur_hp);
+                  Node** cur_ptr, Point &prev_hp, Point &cur_hp);
+
+  R& GetReclaimer() { return ReclaimerRegistry<R>::GetInstance(domain_); }
+
+  std::shared_ptr<Domain> domain_;
 
   Hash hash_func_;
 
@@ -276,44 +288,19 @@ class LockFreeHashTable {
 
   std::atomic<size_t> bucket_size_;
 
-  Segment segments_[KSegMaxSize];
-
-  static HazardList global_hp_list_;
-};
-
-template <typename K, typename V>
-HazardList LockFreeHashTable<K, V>::global_hp_list_;
-
-template <typename K, typename V>
-class HashTableReclaimer : public Reclaimer {
- public:
-  static HashTableReclaimer& GetInstance() {
-    thread_local HashTableReclaimer queueReclaimer =
-        HashTableReclaimer(LockFreeHashTable<K, V>::global_hp_list_);
-    return queueReclaimer;
-  }
-
-  ~ HashTableReclaimer() override {
-    // std::cout << std::this_thread::get_id() << " ~ HashTableReclaimer()\n";
-  }
-
-  HashTableReclaimer() = delete;
-  HashTableReclaimer(const HashTableReclaimer &other) = delete;
-  HashTableReclaimer(HashTableReclaimer &&other) = delete;
-  HashTableReclaimer& operator = (const HashTableReclaimer &other) = delete;
-  HashTableReclaimer& operator = (HashTableReclaimer &&other) = delete;
- private:
-  explicit HashTableReclaimer(HazardList &global_hp_list) : Reclaimer(global_hp_list) { }
+  std::atomic<Directory*> directory_;
 };
 
-template <typename K, typename V>
-bool LockFreeHashTable<K, V>::InsertRegular(Regular *insert_node) {
+template <typename K, typename V, typename R, typename A>
+bool LockFreeHashTable<K, V, R, A>::InsertRegular(Regular *insert_node) {
+  StampBirth(insert_node, *domain_);
+  auto& reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
   Node* prev;
   Node* cur;
-  HazardPoint prev_hp;
-  HazardPoint cur_hp;
+  Point prev_hp;
+  Point cur_hp;
   auto *head = GetBucketByHash(insert_node->hash_);
-  auto& reclaimer = HashTableReclaimer<K, V>::GetInstance();
   do {
     prev_hp.Unmark();
     cur_hp.Unmark();
@@ -321,8 +308,8 @@ bool LockFreeHashTable<K, V>::InsertRegular(Regular *insert_node) {
       V* new_value = insert_node->value_.load(std::memory_order_acquire);
       V* old_value = static_cast<Regular*>(cur)->value_.exchange(
           new_value, std::memory_order_release);
-      reclaimer.ReclaimLater(old_value,
-                             [](void* ptr) { delete static_cast<V*>(ptr); });
+      reclaimer.Retire(old_value, DeleteWith<V, A>);
+      reclaimer.ReclaimNoHazard();
       insert_node->value_.store(nullptr, std::memory_order_release);
       delete insert_node;
       return false;
@@ -363,21 +350,24 @@ bool LockFreeHashTable<K, V>::InsertRegular(Regular *insert_node) {
   // std::cout << cur_size * LoadFactor << " " << size_t(cur_size * LoadFactor) << " " << bucket_size << "\n";
   if (bucket_size != BucketMaxSize && double(bucket_size) * LoadFactor < double(cur_size)) {
     // std::cout << "bucket_size: " << bucket_size + bucket_size << "\n";
+    // 目录先扩容, 读到新 bucket_size_ 的线程一定能读到足够大的目录
+    ReserveBuckets(bucket_size + bucket_size);
     bucket_size_.compare_exchange_strong(bucket_size, bucket_size + bucket_size, std::memory_order_acq_rel);
   }
 //  // std::cout << "InsertRegular 7\n";
   return true;
 }
 
-template <typename K, typename V>
-bool LockFreeHashTable<K, V>::Find(const K &key, V &value) {
+template <typename K, typename V, typename R, typename A>
+bool LockFreeHashTable<K, V, R, A>::Find(const K &key, V &value) {
+  Guard guard(GetReclaimer());
   Regular find_node(key, GetHash(key));
   auto *head = GetBucketByHash(find_node.hash_);
 
   Node *prev;
   Node *cur;
-  HazardPoint prev_hp;
-  HazardPoint cur_hp;
+  Point prev_hp;
+  Point cur_hp;
   if (!SearchNode(head, &find_node, &prev, &cur, prev_hp, cur_hp)) {
     return false;
   }
@@ -385,29 +375,34 @@ bool LockFreeHashTable<K, V>::Find(const K &key, V &value) {
   return true;
 }
 
-template <typename K, typename V>
-bool LockFreeHashTable<K, V>::Delete(const K &key) {
+template <typename K, typename V, typename R, typename A>
+bool LockFreeHashTable<K, V, R, A>::Delete(const K &key) {
+  auto &hashTableReclaimer = GetReclaimer();
+  Guard guard(hashTableReclaimer);
   auto delete_node = Regular(key, GetHash(key));
   auto *head = GetBucketByHash(delete_node.hash_);
   Node *pre;
   Node *cur;
   Node *next;
-  HazardPoint pre_hp;
-  HazardPoint cur_hp;
-  do {
-    do {
-      pre_hp.Unmark();
-      cur_hp.Unmark();
-      if (!SearchNode(head, &delete_node, &pre, &cur, pre_hp, cur_hp)) {
-        return false;
-      }
-      next = cur->next_.load(std::memory_order_acquire);
-    } while (!IsMarked(next));
-  } while (!pre->next_.compare_exchange_strong(next, Marked(next), std::memory_order_acq_rel));
+  Point pre_hp;
+  Point cur_hp;
+  // 先标记 cur->next_ 完成逻辑删除, 标记成功的线程负责这次删除
+  for (;;) {
+    pre_hp.Unmark();
+    cur_hp.Unmark();
+    if (!SearchNode(head, &delete_node, &pre, &cur, pre_hp, cur_hp)) {
+      return false;
+    }
+    next = cur->next_.load(std::memory_order_acquire);
+    if (!IsMarked(next) &&
+        cur->next_.compare_exchange_strong(next, Marked(next), std::memory_order_acq_rel)) {
+      break;
+    }
+  }
   size_.fetch_sub(1, std::memory_order_acq_rel);
   if (pre->next_.compare_exchange_strong(cur, next, std::memory_order_acq_rel)) {
-    auto &hashTableReclaimer = HashTableReclaimer<K, V>::GetInstance();
-    hashTableReclaimer.ReclaimLater(cur, DeleteNode);
+    // 只有 regular 节点会被删除, 按 Regular 退休才能记录节点的实际大小
+    hashTableReclaimer.Retire(static_cast<Regular*>(cur));
     hashTableReclaimer.ReclaimNoHazard();
   } else {
     pre_hp.Unmark();
@@ -417,50 +412,71 @@ bool LockFreeHashTable<K, V>::Delete(const K &key) {
   return true;
 }
 
-template <typename K, typename V>
-LockFreeHashTable<K, V>::Bucket* LockFreeHashTable<K, V>::NewBuckets()  {
-  auto *buckets = new Bucket[KSegMaxSize];
-  return buckets;
+template <typename K, typename V, typename R, typename A>
+LockFreeHashTable<K, V, R, A>::Directory* LockFreeHashTable<K, V, R, A>::NewDirectory(size_t capacity,
+                                                                                      Directory *previous,
+                                                                                      bool mapped) {
+  auto bytes = Directory::Bytes(capacity);
+  void *ptr;
+  if (mapped) {
+#ifdef LOCKFREE_HUGE_PAGES
+    bytes = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+    ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+      return nullptr;
+    }
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+#else
+    return nullptr;
+#endif
+  } else {
+    ptr = ::operator new(bytes);
+    std::memset(ptr, 0, bytes);
+  }
+  // 全零的 bucket 即 nullptr, 匿名映射的页在第一次访问时才清零
+  return new (ptr) Directory(capacity, previous, mapped);
 }
 
-template <typename K, typename V>
-LockFreeHashTable<K, V>::Segment* LockFreeHashTable<K, V>::NewSegments(int level) {
-  auto *segments = new Segment[KSegMaxSize];
-  for (size_t i = 0; i < KSegMaxSize; i++) {
-    segments[i].level_ = level;
+template <typename K, typename V, typename R, typename A>
+void LockFreeHashTable<K, V, R, A>::FreeDirectory(Directory *directory) {
+  if (directory->mapped_) {
+#ifdef LOCKFREE_HUGE_PAGES
+    auto bytes = Directory::Bytes(directory->capacity_);
+    munmap(directory, (bytes + HugePageSize - 1) & ~(HugePageSize - 1));
+#endif
+    return ;
   }
-  return segments;
+  directory->~Directory();
+  ::operator delete(directory);
 }
 
-template <typename K, typename V>
-LockFreeHashTable<K, V>::Dummy* LockFreeHashTable<K, V>::GetBucketByIndex(size_t index) {
-  auto *segments = segments_;
-  for (size_t level = 1; level <= MaxSegLevel; level++) {
-    size_t id = HASH_LEVEL_INDEX(index, level - 1);
-//    // std::cout << id << " level(" << level - 1 << ") ";
-    segments = static_cast<Segment*>(segments[id].data_.load(std::memory_order_acquire));
-    if (segments == nullptr) {
-//      // std::cout << "\n";
-      return nullptr;
+template <typename K, typename V, typename R, typename A>
+void LockFreeHashTable<K, V, R, A>::ReserveBuckets(size_t size) {
+  auto *directory = directory_.load(std::memory_order_acquire);
+  while (directory->capacity_ < size) {
+    auto capacity = directory->capacity_;
+    auto *bigger = NewDirectory(capacity + capacity, directory, false);
+    auto *from = directory->Buckets();
+    auto *to = bigger->Buckets();
+    for (size_t i = 0; i < capacity; i++) {
+      to[i].store(from[i].load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+    // 失败时 directory 更新为其他线程发布的目录
+    if (!directory_.compare_exchange_strong(directory, bigger, std::memory_order_acq_rel)) {
+      FreeDirectory(bigger);
     }
   }
-  size_t id = HASH_LEVEL_INDEX(index, MaxSegLevel);
-//  // std::cout << id << " level(" << MaxSegLevel << ") ";
-  auto *buckets = static_cast<Bucket*>(segments[id].data_.load(std::memory_order_acquire));
-  if (buckets == nullptr) {
-//    // std::cout << "\n";
-    return nullptr;
-  }
-  id = HASH_LEVEL_INDEX(index, BucketLevel);
-//  // std::cout << id << " level(" << BucketLevel << ") ";
-  auto bucket = buckets[id].load(std::memory_order_acquire);
-//  // std::cout << "\n";
-//  // std::cout << (bucket == nullptr) << "\n";
-  return bucket;
 }
 
-template <typename K, typename V>
-LockFreeHashTable<K, V>::Dummy* LockFreeHashTable<K, V>::GetBucketByHash(size_t hash) {
+template <typename K, typename V, typename R, typename A>
+LockFreeHashTable<K, V, R, A>::Dummy* LockFreeHashTable<K, V, R, A>::GetBucketByIndex(size_t index) {
+  auto *directory = directory_.load(std::memory_order_acquire);
+  assert(index < directory->capacity_);
+  return directory->Buckets()[index].load(std::memory_order_acquire);
+}
+
+template <typename K, typename V, typename R, typename A>
+LockFreeHashTable<K, V, R, A>::Dummy* LockFreeHashTable<K, V, R, A>::GetBucketByHash(size_t hash) {
   auto bucket_size = bucket_size_.load(std::memory_order_acquire);
   auto index = hash & (bucket_size - 1);
   // std::cout << index << " :GetBucketByHash\n";
@@ -473,8 +489,8 @@ LockFreeHashTable<K, V>::Dummy* LockFreeHashTable<K, V>::GetBucketByHash(size_t
   return head;
 }
 
-template <typename K, typename V>
-LockFreeHashTable<K, V>::Dummy* LockFreeHashTable<K, V>::InitializeBucket(size_t index) {
+template <typename K, typename V, typename R, typename A>
+LockFreeHashTable<K, V, R, A>::Dummy* LockFreeHashTable<K, V, R, A>::InitializeBucket(size_t index) {
   auto parent_index = GetParentIndex(index);
   // std::cout << "parent index: " << parent_index << "\n";
   auto *parent_head = GetBucketByIndex(parent_index);
@@ -483,68 +499,25 @@ LockFreeHashTable<K, V>::Dummy* LockFreeHashTable<K, V>::InitializeBucket(size_t
     parent_head = InitializeBucket(parent_index);
   }
 
-  // std::cout << index << " InitializeBucket\n";
-  auto *segments = segments_;
-  for (size_t level = 1; level <= MaxSegLevel; level++) {
-    size_t id = HASH_LEVEL_INDEX(index, level - 1);
-    // std::cout << id << " level(" << level - 1 << ", ";
-    auto &segment = segments[id];
-    auto *sub_segments = static_cast<Segment *>(segment.data_.load(std::memory_order_acquire));
-
-    if (sub_segments == nullptr) {
-      // std::cout << "nul) ";
-      sub_segments = NewSegments(level);
-      void *expect = nullptr;
-      if (!segment.data_.compare_exchange_strong(expect, sub_segments, std::memory_order_acq_rel)) {
-        delete [] sub_segments;
-        sub_segments = static_cast<Segment *>(expect);
-      }
-    } else {
-      // std::cout << "hav) ";
-    }
-    segments = sub_segments;
-  }
-  size_t id = HASH_LEVEL_INDEX(index, MaxSegLevel);
-  auto &segment = segments[id];
-  // std::cout << id << " level(" << MaxSegLevel << ", ";
-  auto *buckets = static_cast<Bucket*>(segment.data_.load(std::memory_order_acquire));
-  if (buckets == nullptr) {
-    // std::cout << "nul) ";
-    buckets = NewBuckets();
-    void *expect = nullptr;
-    if (!segment.data_.compare_exchange_strong(expect, buckets, std::memory_order_acq_rel)) {
-      delete []buckets;
-      buckets = static_cast<Bucket*>(expect);
-    }
-  } else {
-    // std::cout << "hav) ";
-  }
-  id = HASH_LEVEL_INDEX(index, BucketLevel);
-  auto &bucket = buckets[id];
-
-  // std::cout << id << " level(" << BucketLevel << ", ";
-
+  auto &bucket = directory_.load(std::memory_order_acquire)->Buckets()[index];
   auto head = bucket.load(std::memory_order_acquire);
   if (head == nullptr) {
-    // std::cout << "nul)\n";
     head = new Dummy(index);
     Dummy *maybe_head;
-    if (InsertDummy(parent_head, head, &maybe_head)) {
-      bucket.store(head, std::memory_order_release);
-    } else {
+    if (!InsertDummy(parent_head, head, &maybe_head)) {
+      // dummy 已经在链表中, 可能是目录复制之后才写入旧目录的
       delete head;
       head = maybe_head;
     }
-  } else {
-    // std::cout << "hav)\n";
+    bucket.store(head, std::memory_order_release);
   }
   // std::cout << "InitializeBucket end\n";
   return head;
 }
 
-template <typename K, typename V>
-bool LockFreeHashTable<K, V>::SearchNode(Dummy *head, Node *search_node, Node **prev_ptr,
-                                         Node **cur_ptr, HazardPoint &prev_hp, HazardPoint &cur_hp) {
+template <typename K, typename V, typename R, typename A>
+bool LockFreeHashTable<K, V, R, A>::SearchNode(Dummy *head, Node *search_node, Node **prev_ptr,
+                                            Node **cur_ptr, Point &prev_hp, Point &cur_hp) {
 //  auto &hashTableReclaimer = HashTableReclaimer<K, V>::GetInstance();
 //
 //try_again:
@@ -593,14 +566,14 @@ bool LockFreeHashTable<K, V>::SearchNode(Dummy *head, Node *search_node, Node **
 //      cur = next;
 //    }
 //  }
-  auto& reclaimer = HashTableReclaimer<K, V>::GetInstance();
+  auto& reclaimer = GetReclaimer();
 try_again:
   Node* prev = head;
   Node* cur = prev->next_.load(std::memory_order_acquire);
   Node* next;
   while (true) {
     cur_hp.Unmark();
-    cur_hp = HazardPoint(&reclaimer, cur);
+    cur_hp = Point(&reclaimer, cur);
     // Make sure prev is the predecessor of cur,
     // so that cur is properly marked as hazard.
     if (prev->next_.load(std::memory_order_acquire) != cur) goto try_again;
@@ -613,11 +586,10 @@ try_again:
 
     next = cur->next_.load(std::memory_order_acquire);
     if (IsMarked(next)) {
-      if (!prev->next_.compare_exchange_strong(cur, Marked(next)))
+      if (!prev->next_.compare_exchange_strong(cur, Unmarked(next)))
         goto try_again;
-      std::string output = "Success Remove: " + static_cast<Regular*>(cur)->key_ + "\n";
-//      std::cout << output;
-      reclaimer.ReclaimLater(cur, LockFreeHashTable<K, V>::DeleteNode);
+      // dummy 节点不会被标记, 被摘除的一定是 regular 节点
+      reclaimer.Retire(static_cast<Regular*>(cur));
       reclaimer.ReclaimNoHazard();
       cur = Unmarked(next);
     } else {
@@ -632,7 +604,7 @@ try_again:
       }
 
       // Swap cur_hp and prev_hp.
-      HazardPoint tmp = std::move(cur_hp);
+      Point tmp = std::move(cur_hp);
       cur_hp = std::move(prev_hp);
       prev_hp = std::move(tmp);
 
@@ -642,12 +614,12 @@ try_again:
   }
 }
 
-template <typename K, typename V>
-bool LockFreeHashTable<K, V>::InsertDummy(Dummy *parent_head, Dummy *head, Dummy **maybe_head) {
+template <typename K, typename V, typename R, typename A>
+bool LockFreeHashTable<K, V, R, A>::InsertDummy(Dummy *parent_head, Dummy *head, Dummy **maybe_head) {
   Node *prev;
   Node *cur;
-  HazardPoint prev_hp;
-  HazardPoint cur_hp;
+  Point prev_hp;
+  Point cur_hp;
   do {
     // std::cout << "InsertDummy loop, order key: " << parent_head->order_key_ << ", " << head->order_key_ << "\n";
     prev_hp.Unmark();
@@ -661,8 +633,8 @@ bool LockFreeHashTable<K, V>::InsertDummy(Dummy *parent_head, Dummy *head, Dummy
   return true;
 }
 
-template <typename K, typename V>
-void LockFreeHashTable<K, V>::DebugPrint() {
+template <typename K, typename V, typename R, typename A>
+void LockFreeHashTable<K, V, R, A>::DebugPrint() {
   auto *head = head_;
   std::cout << "DebugPrint:\n";
   std::string debug_data;
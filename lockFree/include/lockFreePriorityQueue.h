@@ -0,0 +1,356 @@
+#ifndef LOCKFREEPRIORITYQUEUE_H_
+#define LOCKFREEPRIORITYQUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+#include "reclaim.h"
+#include "inlineValue.h"
+
+namespace lockFree {
+
+constexpr int SkipListMaxLevel = 16;
+
+constexpr size_t PriorityRelaxation = 8;
+
+/*
+ * 基于无锁跳表的优先队列, 节点按 (优先级, 节点地址) 排序, 相同优先级的元素可以共存
+ * 删除分两步: 先用 taken_ 抢占节点 (逻辑出队), 再自顶向下标记每一层的 next_, 由 Find 把标记的节点从各层摘下
+ * Pop 抢占最底层第一个没有被抢占的节点; PopRelaxed 随机跳过前 relaxation 个元素中的若干个,
+ * 让并发的出队分散到表头附近的不同节点上, 代价是出队的不一定是当前最小的元素
+ * 节点可能同时链接在多层上, links_ 记录链接的层数再加上插入线程持有的一次引用, 减到 0 时节点已经从所有层摘下, 才交给 R 退休
+ * R 为回收策略, 节点继承 R::NodeBase, 不指定 domain 时使用同类型优先队列共享的默认 domain
+ */
+template<typename K, typename V, typename R = Reclaimer, typename Compare = std::less<K>>
+class LockFreePriorityQueue {
+ public:
+  using Domain = typename R::Domain;
+
+  explicit LockFreePriorityQueue(size_t relaxation = PriorityRelaxation)
+      : LockFreePriorityQueue(DefaultDomain(), relaxation) {}
+
+  explicit LockFreePriorityQueue(std::shared_ptr<Domain> domain, size_t relaxation = PriorityRelaxation)
+      : domain_(std::move(domain)), relaxation_(std::max<size_t>(relaxation, 1)), head_(new Node(SkipListMaxLevel)),
+        level_(1), size_(0) {}
+
+  // 已经从最底层摘下的节点可能还链接在更高的层上, 收集所有层上的节点, 每个只释放一次
+  ~ LockFreePriorityQueue() {
+    std::vector<Node*> nodes;
+    for (int level = 0; level < SkipListMaxLevel; level++) {
+      auto *p = Unmarked(head_->next_[level].load(std::memory_order_acquire));
+      while (p) {
+        nodes.push_back(p);
+        p = Unmarked(p->next_[level].load(std::memory_order_acquire));
+      }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    for (auto *p : nodes) {
+      delete p;
+    }
+    delete head_;
+  }
+
+  void Push(const K &priority, const V &value) { Emplace(priority, value); }
+
+  void Push(const K &priority, V &&value) { Emplace(priority, std::move(value)); }
+
+  // 出队当前优先级最小的元素, 为空时返回 false
+  bool Pop(K &priority, V &value) { return DeleteMin(priority, value, 0); }
+
+  // 出队最小的 relaxation 个元素中的一个
+  bool PopRelaxed(K &priority, V &value) { return DeleteMin(priority, value, RandomNumber() % relaxation_); }
+
+  size_t Size() {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  static size_t Global_Size() {
+    return DefaultDomain()->Size();
+  }
+
+  static std::shared_ptr<Domain> DefaultDomain() {
+    static auto domain = std::make_shared<Domain>();
+    return domain;
+  }
+
+  const std::shared_ptr<Domain>& GetDomain() const {
+    return domain_;
+  }
+
+  LockFreePriorityQueue(const LockFreePriorityQueue &other) = delete;
+  LockFreePriorityQueue(LockFreePriorityQueue &&other) = delete;
+  LockFreePriorityQueue& operator = (const LockFreePriorityQueue &other) = delete;
+  LockFreePriorityQueue& operator = (LockFreePriorityQueue &&other) = delete;
+
+ private:
+  using Point = typename R::Point;
+  using Guard = typename R::Guard;
+
+  struct Node : public R::NodeBase {
+    explicit Node(int height) : height_(height), taken_(false), links_(1) {
+      for (auto &next : next_) {
+        next.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    ~ Node() = default;
+
+    Node(const Node &other) = delete;
+    Node(Node &&other) = delete;
+    Node& operator = (const Node &other) = delete;
+    Node& operator = (Node &&other) = delete;
+
+    // 头节点不持有优先级和元素
+    InlineValue<K> key_;
+    InlineValue<V> value_;
+    const int height_;
+    std::atomic<bool> taken_;
+    std::atomic<int> links_;
+    std::atomic<Node*> next_[SkipListMaxLevel];
+  };
+
+  static Node* Marked(Node *ptr) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uint64_t>(ptr) | (0x1));
+  }
+
+  static Node* Unmarked(Node *ptr) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uint64_t>(ptr) & (~0x1));
+  }
+
+  static bool IsMarked(Node *ptr) {
+    return (reinterpret_cast<uint64_t>(ptr) & 0x1) == 0x1;
+  }
+
+  // 优先级相同时按地址排序, 链表中的节点都没有被退休, 地址互不相同
+  bool Less(Node *a, Node *b) {
+    if (compare_(a->key_.Get(), b->key_.Get())) {
+      return true;
+    }
+    if (compare_(b->key_.Get(), a->key_.Get())) {
+      return false;
+    }
+    return a < b;
+  }
+
+  template<typename ArgV>
+  void Emplace(const K &priority, ArgV &&value);
+
+  bool DeleteMin(K &priority, V &value, size_t skip);
+
+  /*
+   * 在每一层找到 target 的前驱 preds[level] 和第一个不小于 target 的节点 succs[level], 沿途摘下被标记的节点
+   * preds 为 nullptr 时只负责摘下节点, 否则返回时 preds / succs 由 preds_hp / succs_hp 保护
+   */
+  void Find(R &reclaimer, Node *target, Node **preds, Node **succs, Point *preds_hp, Point *succs_hp);
+
+  // 节点从某一层摘下或插入线程放弃引用, 最后一次释放的线程负责退休
+  void Release(R &reclaimer, Node *node) {
+    if (node->links_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      reclaimer.Retire(node);
+      reclaimer.ReclaimNoHazard();
+    }
+  }
+
+  int RandomHeight() {
+    auto height = __builtin_ctz(~RandomNumber()) + 1;
+    return std::min(height, SkipListMaxLevel);
+  }
+
+  static uint32_t RandomNumber() {
+    // xorshift, 每个线程独立的种子
+    thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  R& GetReclaimer() { return ReclaimerRegistry<R>::GetInstance(domain_); }
+
+
+  std::shared_ptr<Domain> domain_;
+  Compare compare_;
+  const size_t relaxation_;
+  Node *const head_;
+  // 出现过的最大层数, Find 从这一层开始向下查找
+  std::atomic<int> level_;
+  std::atomic<size_t> size_;
+};
+
+template<typename K, typename V, typename R, typename Compare>
+void LockFreePriorityQueue<K, V, R, Compare>::Find(R &reclaimer, Node *target, Node **preds, Node **succs,
+                                                   Point *preds_hp, Point *succs_hp) {
+  Point pred_hp;
+  Point cur_hp;
+try_again:
+  Node *pred = head_;
+  for (int level = level_.load(std::memory_order_acquire) - 1; level >= 0; level--) {
+    Node *cur = pred->next_[level].load(std::memory_order_acquire);
+    for (;;) {
+      cur_hp.Unmark();
+      cur_hp = Point(&reclaimer, cur);
+      // pred 没有被标记且仍然指向 cur, cur 就还链接在这一层上, 没有被退休
+      if (IsMarked(cur) || pred->next_[level].load(std::memory_order_acquire) != cur) {
+        goto try_again;
+      }
+      if (cur == nullptr) {
+        break;
+      }
+      Node *succ = cur->next_[level].load(std::memory_order_acquire);
+      if (IsMarked(succ)) {
+        if (!pred->next_[level].compare_exchange_strong(cur, Unmarked(succ), std::memory_order_acq_rel)) {
+          goto try_again;
+        }
+        Release(reclaimer, cur);
+        cur = Unmarked(succ);
+        continue;
+      }
+      if (!Less(cur, target)) {
+        break;
+      }
+      Point tmp = std::move(pred_hp);
+      pred_hp = std::move(cur_hp);
+      cur_hp = std::move(tmp);
+      pred = cur;
+      cur = succ;
+    }
+    if (preds != nullptr) {
+      // pred 和 cur 此时都被保护, 直接占用新的 hazard 不需要重新确认
+      preds[level] = pred;
+      succs[level] = cur;
+      preds_hp[level].Unmark();
+      preds_hp[level] = Point(&reclaimer, pred);
+      succs_hp[level].Unmark();
+      succs_hp[level] = Point(&reclaimer, cur);
+    }
+  }
+}
+
+template<typename K, typename V, typename R, typename Compare> template<typename ArgV>
+void LockFreePriorityQueue<K, V, R, Compare>::Emplace(const K &priority, ArgV &&value) {
+  auto height = RandomHeight();
+  auto *node = new Node(height);
+  StampBirth(node, *domain_);
+  // 优先级或元素构造失败时节点还没有链接, 直接释放, 已经构造的 key_ 随节点析构
+  try {
+    node->key_.Construct(priority);
+    node->value_.Construct(std::forward<ArgV>(value));
+  } catch (...) {
+    delete node;
+    throw;
+  }
+  auto level = level_.load(std::memory_order_relaxed);
+  while (level < height && !level_.compare_exchange_weak(level, height, std::memory_order_acq_rel)) {}
+  // 先计数再链接, Size 不会因为出队早于计数而下溢
+  size_.fetch_add(1, std::memory_order_acq_rel);
+
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Node *preds[SkipListMaxLevel];
+  Node *succs[SkipListMaxLevel];
+  Point preds_hp[SkipListMaxLevel];
+  Point succs_hp[SkipListMaxLevel];
+  // 链接到最底层之后节点才可以被出队
+  for (;;) {
+    Find(reclaimer, node, preds, succs, preds_hp, succs_hp);
+    node->next_[0].store(succs[0], std::memory_order_relaxed);
+    node->links_.fetch_add(1, std::memory_order_relaxed);
+    if (preds[0]->next_[0].compare_exchange_strong(succs[0], node, std::memory_order_acq_rel)) {
+      break;
+    }
+    node->links_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  // 自底向上链接其余的层, 节点已经被出队线程标记时停止
+  for (int i = 1; i < height; i++) {
+    for (;;) {
+      auto *next = node->next_[i].load(std::memory_order_acquire);
+      if (IsMarked(next) ||
+          !node->next_[i].compare_exchange_strong(next, succs[i], std::memory_order_acq_rel)) {
+        goto done;
+      }
+      node->links_.fetch_add(1, std::memory_order_relaxed);
+      if (preds[i]->next_[i].compare_exchange_strong(succs[i], node, std::memory_order_acq_rel)) {
+        // 链接之前出队线程已经完成了查找, 由插入线程把这一层摘下
+        if (IsMarked(node->next_[i].load(std::memory_order_acquire))) {
+          Find(reclaimer, node, nullptr, nullptr, nullptr, nullptr);
+          goto done;
+        }
+        break;
+      }
+      node->links_.fetch_sub(1, std::memory_order_relaxed);
+      Find(reclaimer, node, preds, succs, preds_hp, succs_hp);
+    }
+  }
+done:
+  Release(reclaimer, node);
+}
+
+template<typename K, typename V, typename R, typename Compare>
+bool LockFreePriorityQueue<K, V, R, Compare>::DeleteMin(K &priority, V &value, size_t skip) {
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point pred_hp;
+  Point cur_hp;
+  Node *cur;
+try_again:
+  {
+    Node *pred = head_;
+    cur = pred->next_[0].load(std::memory_order_acquire);
+    size_t live = 0;
+    for (;;) {
+      cur_hp.Unmark();
+      cur_hp = Point(&reclaimer, cur);
+      if (IsMarked(cur) || pred->next_[0].load(std::memory_order_acquire) != cur) {
+        goto try_again;
+      }
+      if (cur == nullptr) {
+        if (live == 0) {
+          return false;
+        }
+        // 没有被抢占的元素不足 skip 个, 退化为严格出队
+        skip = 0;
+        goto try_again;
+      }
+      Node *succ = cur->next_[0].load(std::memory_order_acquire);
+      // 帮助摘下已经被标记的节点, 否则 pred 被标记后无法继续向后确认
+      if (IsMarked(succ)) {
+        if (!pred->next_[0].compare_exchange_strong(cur, Unmarked(succ), std::memory_order_acq_rel)) {
+          goto try_again;
+        }
+        Release(reclaimer, cur);
+        cur = Unmarked(succ);
+        continue;
+      }
+      if (!cur->taken_.load(std::memory_order_acquire) && live++ >= skip &&
+          !cur->taken_.exchange(true, std::memory_order_acq_rel)) {
+        break;
+      }
+      Point tmp = std::move(pred_hp);
+      pred_hp = std::move(cur_hp);
+      cur_hp = std::move(tmp);
+      pred = cur;
+      cur = succ;
+    }
+  }
+  size_.fetch_sub(1, std::memory_order_acq_rel);
+  // 优先级还要用于查找, 只能复制
+  priority = cur->key_.Get();
+  value = std::move(cur->value_.Get());
+  // 自顶向下标记, 插入线程看到标记后不再链接更高的层
+  for (int i = cur->height_ - 1; i >= 0; i--) {
+    auto *next = cur->next_[i].load(std::memory_order_acquire);
+    while (!IsMarked(next) &&
+           !cur->next_[i].compare_exchange_weak(next, Marked(next), std::memory_order_acq_rel)) {}
+  }
+  Find(reclaimer, cur, nullptr, nullptr, nullptr, nullptr);
+  return true;
+}
+
+}
+
+#endif
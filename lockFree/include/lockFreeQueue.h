@@ -2,16 +2,28 @@
 #define LOCKFREEQUEUE_H_
 
 #include "reclaim.h"
+#include "inlineValue.h"
+#include "slabAllocator.h"
+#include "eventCount.h"
 
 namespace lockFree {
 
-template<typename T>
-class QueueReclaimer;
-
-template<typename T>
+/*
+ * Michael-Scott 队列, front_ 指向哨兵节点, 元素保存在哨兵之后的节点中, 出队后原来的下一个节点成为新的哨兵
+ * R 为回收策略, 可选 Reclaimer(hazard pointer), EpochReclaimer(epoch-based reclamation)
+ * 或 EraReclaimer(hazard eras), 节点继承 R::NodeBase
+ * A 为节点的分配器策略, 默认 NewAllocator, 可选 SlabAllocator<>, 回收器释放的节点同样回到 A
+ * 不指定 domain 时使用同类型队列共享的默认 domain
+ */
+template<typename T, typename R = Reclaimer, typename A = NewAllocator>
 class LockFreeQueue {
  public:
-  LockFreeQueue() : front_(new Data()), tail_(front_.load(std::memory_order_relaxed)), size_(0) {}
+  using Domain = typename R::Domain;
+
+  LockFreeQueue() : LockFreeQueue(DefaultDomain()) {}
+
+  explicit LockFreeQueue(std::shared_ptr<Domain> domain)
+      : domain_(std::move(domain)), front_(new Data()), tail_(front_.load(std::memory_order_relaxed)), size_(0) {}
 
   ~ LockFreeQueue() {
     auto p = front_.load(std::memory_order_acquire);
@@ -28,12 +40,40 @@ class LockFreeQueue {
 
   bool Pop(T &data);
 
+  // 队列为空时先自旋一小段时间, 之后睡眠直到有新的元素
+  void PopWait(T &data) {
+    WaitUntil(not_empty_, [this, &data]() { return Pop(data); });
+  }
+
+  // 超时返回 false
+  template<typename Rep, typename Period>
+  bool PopWaitFor(T &data, const std::chrono::duration<Rep, Period> &timeout) {
+    return WaitUntilFor(not_empty_, [this, &data]() { return Pop(data); }, timeout);
+  }
+
+  // 在私有链表中构造 [first, last) 的全部元素, 只用一次 CAS 把整条链接到队尾
+  template<typename InputIt>
+  void PushBulk(InputIt first, InputIt last);
+
+  // 一次 CAS 摘下最多 max 个元素依次写入 out, 返回出队的个数
+  template<typename OutputIt>
+  size_t PopBulk(OutputIt out, size_t max);
+
   size_t Size() {
     return size_.load(std::memory_order_acquire);
   }
 
   static size_t Global_Size() {
-    return global_hp_list_.Size();
+    return DefaultDomain()->Size();
+  }
+
+  static std::shared_ptr<Domain> DefaultDomain() {
+    static auto domain = std::make_shared<Domain>();
+    return domain;
+  }
+
+  const std::shared_ptr<Domain>& GetDomain() const {
+    return domain_;
   }
 
   LockFreeQueue(const LockFreeQueue &other) = delete;
@@ -42,129 +82,221 @@ class LockFreeQueue {
   LockFreeQueue& operator = (LockFreeQueue &&other) = delete;
 
  private:
-  friend QueueReclaimer<T>;
+  using Point = typename R::Point;
+  using Guard = typename R::Guard;
 
   struct Data;
 
+  template<typename Arg>
+  Data* NewNode(Arg &&arg);
+
+  // 释放一条还没有发布的私有链表
+  static void FreeChain(Data *first);
+
   template<typename Arg>
   void Emplace(Arg &&arg);
 
-  Data* AcquireSafeNode(std::atomic<Data*>& atomic_node, HazardPoint& hp);
+  // 把 first ~ last 这条已经链接好的私有链表接到队尾
+  void LinkChain(Data *first, Data *last);
 
-  bool InsertNewTail(Data *old_tail, Data *new_tail);
+  Data* AcquireSafeNode(std::atomic<Data*>& atomic_node, Point& hp);
 
-  static void DeleteData(void *ptr) { delete static_cast<Data*>(ptr); }
+  R& GetReclaimer() { return ReclaimerRegistry<R>::GetInstance(domain_); }
 
-  struct Data {
-    Data() : data_(nullptr), next_(nullptr) {}
 
-    ~ Data() {
-      auto p = data_.load(std::memory_order_acquire);
-      delete p;
-    }
+  struct Data : public R::NodeBase, public AllocatedBy<A> {
+    Data() : next_(nullptr) {}
+    ~ Data() = default;
 
     Data(const Data &other) = delete;
     Data(Data &&other) = delete;
     Data& operator = (const Data &other) = delete;
     Data& operator = (Data &&other) = delete;
 
-    std::atomic<T*> data_;
     std::atomic<Data*> next_;
+    InlineValue<T> value_;
   };
 
+  std::shared_ptr<Domain> domain_;
   std::atomic<Data*> front_;
   std::atomic<Data*> tail_;
   std::atomic<size_t> size_;
-  static HazardList global_hp_list_;
+  EventCount not_empty_;
 };
 
-template<typename T>
-HazardList LockFreeQueue<T>::global_hp_list_;
+template<typename T, typename R, typename A> template<typename Arg>
+LockFreeQueue<T, R, A>::Data* LockFreeQueue<T, R, A>::NewNode(Arg &&arg) {
+  auto *node = new Data();
+  StampBirth(node, *domain_);
+  // 元素构造失败时节点还没有入队, 直接释放
+  try {
+    node->value_.Construct(std::forward<Arg>(arg));
+  } catch (...) {
+    delete node;
+    throw;
+  }
+  return node;
+}
 
-template<typename T>
-class QueueReclaimer : public Reclaimer {
- public:
-  static QueueReclaimer& GetInstance() {
-    thread_local QueueReclaimer queueReclaimer =
-        QueueReclaimer(LockFreeQueue<T>::global_hp_list_);
-    return queueReclaimer;
+template<typename T, typename R, typename A>
+void LockFreeQueue<T, R, A>::FreeChain(Data *first) {
+  while (first != nullptr) {
+    auto *next = first->next_.load(std::memory_order_relaxed);
+    delete first;
+    first = next;
   }
+}
 
-  ~ QueueReclaimer() override = default;
+template<typename T, typename R, typename A> template<typename Arg>
+void LockFreeQueue<T, R, A>::Emplace(Arg &&arg) {
+  auto *new_tail = NewNode(std::forward<Arg>(arg));
+  // 先计数再链接, Size 不会因为出队早于计数而下溢
+  size_.fetch_add(1, std::memory_order_acq_rel);
+  LinkChain(new_tail, new_tail);
+  not_empty_.Notify();
+}
 
-  QueueReclaimer() = delete;
-  QueueReclaimer(const QueueReclaimer &other) = delete;
-  QueueReclaimer(QueueReclaimer &&other) = delete;
-  QueueReclaimer& operator = (const QueueReclaimer &other) = delete;
-  QueueReclaimer& operator = (QueueReclaimer &&other) = delete;
- private:
-  explicit QueueReclaimer(HazardList &global_hp_list) : Reclaimer(global_hp_list) { }
-};
+template<typename T, typename R, typename A> template<typename InputIt>
+void LockFreeQueue<T, R, A>::PushBulk(InputIt first, InputIt last) {
+  Data *head = nullptr;
+  Data *tail = nullptr;
+  size_t count = 0;
+  // 某个元素构造失败时前面的节点都还在私有链表中, 全部释放后再抛出
+  try {
+    for (; first != last; ++first, ++count) {
+      auto *node = NewNode(*first);
+      if (head == nullptr) {
+        head = node;
+      } else {
+        tail->next_.store(node, std::memory_order_relaxed);
+      }
+      tail = node;
+    }
+  } catch (...) {
+    FreeChain(head);
+    throw;
+  }
+  if (count == 0) {
+    return ;
+  }
+  size_.fetch_add(count, std::memory_order_acq_rel);
+  LinkChain(head, tail);
+  not_empty_.NotifyAll();
+}
 
-template<typename T> template<typename Arg>
-void LockFreeQueue<T>::Emplace(Arg &&arg) {
-  T *data = new T(std::forward<Arg>(arg));
-  auto *new_tail = new Data();
+/*
+ * 整条链接上之后 tail_ 直接推进到链尾, 推进失败时其他线程按 MS 队列的方式逐个节点帮助推进
+ */
+template<typename T, typename R, typename A>
+void LockFreeQueue<T, R, A>::LinkChain(Data *first, Data *last) {
+  Guard guard(GetReclaimer());
+  Point hp;
   for (;;) {
-    HazardPoint hp;
-    auto tail = AcquireSafeNode(tail_, hp);
-    T *null_ptr = nullptr;
-    if (tail->data_.compare_exchange_strong(null_ptr, data, std::memory_order_acq_rel)) {
-      if (!InsertNewTail(tail, new_tail)) {
-        delete new_tail;
-      }
+    auto *tail = AcquireSafeNode(tail_, hp);
+    auto *next = tail->next_.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      // tail_ 落后, 帮助推进
+      tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+      continue;
+    }
+    if (tail->next_.compare_exchange_strong(next, first, std::memory_order_acq_rel)) {
+      tail_.compare_exchange_strong(tail, last, std::memory_order_acq_rel);
       return ;
-    } else {
-      if(InsertNewTail(tail, new_tail)) {
-        new_tail = new Data();
-      }
     }
   }
 }
 
-template<typename T>
-bool LockFreeQueue<T>::Pop(T &data) {
-  HazardPoint hp;
+template<typename T, typename R, typename A>
+bool LockFreeQueue<T, R, A>::Pop(T &data) {
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point front_hp;
+  Point next_hp;
   Data *front;
-  Data *new_front;
-  do {
-    front = AcquireSafeNode(front_, hp);
-    if (front == tail_.load(std::memory_order_acquire)) {
+  Data *next;
+  for (;;) {
+    front = AcquireSafeNode(front_, front_hp);
+    auto *tail = tail_.load(std::memory_order_acquire);
+    next = AcquireSafeNode(front->next_, next_hp);
+    // front 仍然是哨兵时 next 还没有出队, 对 next 的保护是有效的
+    if (front != front_.load(std::memory_order_acquire)) {
+      continue;
+    }
+    if (next == nullptr) {
       return false;
     }
-    new_front = front->next_.load(std::memory_order_acquire);
-  } while (!front_.compare_exchange_strong(front, new_front, std::memory_order_acq_rel));
+    if (front == tail) {
+      tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+      continue;
+    }
+    if (front_.compare_exchange_strong(front, next, std::memory_order_acq_rel)) {
+      break;
+    }
+  }
   size_.fetch_sub(1, std::memory_order_acq_rel);
-  data = std::forward<T>(*front->data_.load(std::memory_order_acquire));
-  auto &reclaimer = QueueReclaimer<T>::GetInstance();
-  reclaimer.ReclaimLater(front, DeleteData);
+  // 只有出队成功的线程访问 next 的元素, next 成为新的哨兵, 元素随节点一起析构
+  data = std::move(next->value_.Get());
+  reclaimer.Retire(front);
   reclaimer.ReclaimNoHazard();
   return true;
 }
 
-template<typename T>
-LockFreeQueue<T>::Data* LockFreeQueue<T>::AcquireSafeNode(std::atomic<Data *> &atomic_node, HazardPoint &hp) {
-  auto &reclaimer = QueueReclaimer<T>::GetInstance();
-  auto *node = atomic_node.load(std::memory_order_acquire);
-  Data *temp;
-  do {
-    hp.Unmark();
-    temp = node;
-    hp = HazardPoint(&reclaimer, node);
-    node = atomic_node.load(std::memory_order_acquire);
-  } while (temp != node);
-  return node;
+/*
+ * 从哨兵开始逐个保护后继节点, 每保护一个都确认 front_ 没有变化:
+ * 受保护的哨兵地址不会被复用, front_ 不变说明期间没有出队, 已经读到的链表都还在队列中
+ * 最多走到读取时的 tail_, tail_ 只会向后推进, 摘下的节点不会再被 tail_ 引用
+ */
+template<typename T, typename R, typename A> template<typename OutputIt>
+size_t LockFreeQueue<T, R, A>::PopBulk(OutputIt out, size_t max) {
+  if (max == 0) {
+    return 0;
+  }
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point front_hp;
+  Point hps[2];
+  Data *front;
+  size_t count;
+  for (;;) {
+    front = AcquireSafeNode(front_, front_hp);
+    auto *tail = tail_.load(std::memory_order_acquire);
+    if (front == tail) {
+      auto *next = front->next_.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        return 0;
+      }
+      tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+      continue;
+    }
+    auto *last = front;
+    bool valid = true;
+    for (count = 0; count < max && last != tail; count++) {
+      last = AcquireSafeNode(last->next_, hps[count & 1]);
+      if (front != front_.load(std::memory_order_acquire)) {
+        valid = false;
+        break;
+      }
+    }
+    if (valid && front_.compare_exchange_strong(front, last, std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+  size_.fetch_sub(count, std::memory_order_acq_rel);
+  // 摘下的节点只有当前线程会退休, 不需要继续保护; 最后一个节点成为新的哨兵, 元素同样只由当前线程取出
+  auto *node = front;
+  for (size_t i = 0; i < count; i++) {
+    auto *next = node->next_.load(std::memory_order_acquire);
+    *out++ = std::move(next->value_.Get());
+    reclaimer.Retire(node);
+    node = next;
+  }
+  reclaimer.ReclaimNoHazard();
+  return count;
 }
 
-template<typename T>
-bool LockFreeQueue<T>::InsertNewTail(Data *old_tail, Data *new_tail) {
-  Data *null_ptr = nullptr;
-  if (old_tail->next_.compare_exchange_strong(null_ptr, new_tail, std::memory_order_acq_rel)) {
-    tail_.store(new_tail, std::memory_order_release);
-    size_.fetch_add(1, std::memory_order_acq_rel);
-    return true;
-  }
-  return false;
+template<typename T, typename R, typename A>
+LockFreeQueue<T, R, A>::Data* LockFreeQueue<T, R, A>::AcquireSafeNode(std::atomic<Data *> &atomic_node, Point &hp) {
+  return GetReclaimer().Protect(atomic_node, hp);
 }
 
 }
@@ -4,17 +4,27 @@
 #include <cassert>
 
 #include "reclaim.h"
+#include "inlineValue.h"
+#include "slabAllocator.h"
+#include "eventCount.h"
 
 namespace lockFree {
 
-template<typename T>
-class StackReclaimer;
-
-template<typename T>
+/*
+ * R 为回收策略, 可选 Reclaimer(hazard pointer), EpochReclaimer(epoch-based reclamation)
+ * 或 EraReclaimer(hazard eras), 节点继承 R::NodeBase
+ * A 为节点的分配器策略, 默认 NewAllocator, 可选 SlabAllocator<>, 回收器释放的节点同样回到 A
+ * 不指定 domain 时使用同类型栈共享的默认 domain
+ */
+template<typename T, typename R = Reclaimer, typename A = NewAllocator>
 class LockFreeStack {
  public:
-  LockFreeStack()
-      : front_(new Data()), tail_(front_.load(std::memory_order_acquire)), size_(0) {}
+  using Domain = typename R::Domain;
+
+  LockFreeStack() : LockFreeStack(DefaultDomain()) {}
+
+  explicit LockFreeStack(std::shared_ptr<Domain> domain)
+      : domain_(std::move(domain)), front_(new Data()), tail_(front_.load(std::memory_order_acquire)), size_(0) {}
 
   ~ LockFreeStack() {
     auto *p = front_.load(std::memory_order_acquire);
@@ -31,10 +41,38 @@ class LockFreeStack {
 
   bool Pop(T &data);
 
+  // 栈为空时先自旋一小段时间, 之后睡眠直到有新的元素
+  void PopWait(T &data) {
+    WaitUntil(not_empty_, [this, &data]() { return Pop(data); });
+  }
+
+  // 超时返回 false
+  template<typename Rep, typename Period>
+  bool PopWaitFor(T &data, const std::chrono::duration<Rep, Period> &timeout) {
+    return WaitUntilFor(not_empty_, [this, &data]() { return Pop(data); }, timeout);
+  }
+
+  // 在私有链表中构造 [first, last) 的全部元素, 只用一次 CAS 压入, 最后一个元素位于栈顶
+  template<typename InputIt>
+  void PushBulk(InputIt first, InputIt last);
+
+  // 一次 CAS 摘下最多 max 个元素依次写入 out, 返回出栈的个数
+  template<typename OutputIt>
+  size_t PopBulk(OutputIt out, size_t max);
+
   size_t Size() { return size_.load(std::memory_order_acquire); }
 
   static size_t Global_Size() {
-    return global_hp_list_.Size();
+    return DefaultDomain()->Size();
+  }
+
+  static std::shared_ptr<Domain> DefaultDomain() {
+    static auto domain = std::make_shared<Domain>();
+    return domain;
+  }
+
+  const std::shared_ptr<Domain>& GetDomain() const {
+    return domain_;
   }
 
   LockFreeStack(const LockFreeStack &other) = delete;
@@ -42,108 +80,214 @@ class LockFreeStack {
   LockFreeStack& operator = (const LockFreeStack &other) = delete;
   LockFreeStack& operator = (LockFreeStack &&other) = delete;
 
- private:
-  friend StackReclaimer<T>;
+ protected:
+  using Point = typename R::Point;
+  using Guard = typename R::Guard;
 
-  struct Data {
-    Data() : data_(nullptr), next_(nullptr) {}
-    ~ Data() {
-      auto *data = data_.load(std::memory_order_acquire);
-      delete data;
-    }
+  struct Data : public R::NodeBase, public AllocatedBy<A> {
+    Data() : next_(nullptr) {}
+    ~ Data() = default;
 
     Data(const Data &other) = delete;
     Data(Data &&other) = delete;
     Data& operator = (const Data &other) = delete;
     Data& operator = (Data &&other) = delete;
 
-    std::atomic<T*> data_;
     std::atomic<Data*> next_;
+    InlineValue<T> value_;
   };
 
+  enum class PopResult { Success, Empty, Contended };
+
+  template<typename Arg>
+  Data* NewNode(Arg &&arg);
+
+  // 释放一条还没有发布的私有链表
+  static void FreeChain(Data *first);
+
+  // 把 first ~ last 这条私有链表压入栈中, 只尝试一次 CAS, 失败说明 front_ 上有竞争
+  bool TryPush(Data *first, Data *last);
+
+  PopResult TryPop(Point &hp, Data **front);
+
+  // 取出已经摘下的节点中的元素并退休节点
+  void FinishPop(R &reclaimer, Data *front, T &data);
+
   template<typename Arg>
   void Emplace(Arg &&arg);
 
-  Data* AcquireSafeNode(std::atomic<Data*>& atomic_node, HazardPoint& hp);
+  Data* AcquireSafeNode(std::atomic<Data*>& atomic_node, Point& hp);
+
+  R& GetReclaimer() { return ReclaimerRegistry<R>::GetInstance(domain_); }
 
-  static void DeleteData(void *data) { delete static_cast<Data*>(data); }
 
+  std::shared_ptr<Domain> domain_;
   std::atomic<Data*> front_;
   std::atomic<Data*> tail_;
   std::atomic<size_t> size_;
-
-  static HazardList global_hp_list_;
+  EventCount not_empty_;
 };
 
-template<typename T> HazardList LockFreeStack<T>::global_hp_list_;
+template<typename T, typename R, typename A> template<typename Arg>
+LockFreeStack<T, R, A>::Data* LockFreeStack<T, R, A>::NewNode(Arg &&arg) {
+  auto *node = new Data();
+  StampBirth(node, *domain_);
+  // 元素构造失败时节点还没有入栈, 直接释放
+  try {
+    node->value_.Construct(std::forward<Arg>(arg));
+  } catch (...) {
+    delete node;
+    throw;
+  }
+  return node;
+}
+
+template<typename T, typename R, typename A>
+void LockFreeStack<T, R, A>::FreeChain(Data *first) {
+  while (first != nullptr) {
+    auto *next = first->next_.load(std::memory_order_relaxed);
+    delete first;
+    first = next;
+  }
+}
 
-template<typename T>
-class StackReclaimer : public Reclaimer {
- public:
-  static StackReclaimer& GetInstance() {
-    thread_local StackReclaimer stackReclaimer =
-        StackReclaimer(LockFreeStack<T>::global_hp_list_);
-    return stackReclaimer;
+template<typename T, typename R, typename A>
+bool LockFreeStack<T, R, A>::TryPush(Data *first, Data *last) {
+  // 入栈不会访问 front 指向的节点, 不需要保护, 只比较指针也不受 ABA 影响
+  auto *front = front_.load(std::memory_order_acquire);
+  last->next_.store(front, std::memory_order_relaxed);
+  return front_.compare_exchange_strong(front, first, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+template<typename T, typename R, typename A>
+LockFreeStack<T, R, A>::PopResult LockFreeStack<T, R, A>::TryPop(Point &hp, Data **front) {
+  *front = AcquireSafeNode(front_, hp);
+  auto *new_front = (*front)->next_.load(std::memory_order_acquire);
+  if (new_front == nullptr) {
+    return PopResult::Empty;
+  }
+  if (!front_.compare_exchange_strong(*front, new_front, std::memory_order_acq_rel)) {
+    return PopResult::Contended;
   }
+  return PopResult::Success;
+}
 
-  ~ StackReclaimer() override = default;
+template<typename T, typename R, typename A>
+void LockFreeStack<T, R, A>::FinishPop(R &reclaimer, Data *front, T &data) {
+  size_.fetch_sub(1, std::memory_order_acq_rel);
+  data = std::move(front->value_.Get());
+  reclaimer.Retire(front);
+  reclaimer.ReclaimNoHazard();
+}
 
-  StackReclaimer() = delete;
-  StackReclaimer(const StackReclaimer &other) = delete;
-  StackReclaimer(StackReclaimer &&other) = delete;
-  StackReclaimer& operator = (const StackReclaimer &other) = delete;
-  StackReclaimer& operator = (StackReclaimer &&other) = delete;
- private:
-  explicit StackReclaimer(HazardList &global_hp_list) : Reclaimer(global_hp_list) {}
-};
+template<typename T, typename R, typename A> template<typename Arg>
+void LockFreeStack<T, R, A>::Emplace(Arg &&arg) {
+  auto *node = NewNode(std::forward<Arg>(arg));
+  // 先计数再链接, Size 不会因为出栈早于计数而下溢
+  size_.fetch_add(1, std::memory_order_acq_rel);
+  while (!TryPush(node, node));
+  not_empty_.Notify();
+}
 
-template<typename T> template<typename Arg>
-void LockFreeStack<T>::Emplace(Arg &&arg) {
-  auto *new_front = new Data();
-  new_front->data_.store(new T(std::forward<Arg>(arg)), std::memory_order_release);
-  for (;;) {
-    HazardPoint hp;
-    auto *front = AcquireSafeNode(front_, hp);
-    new_front->next_.store(front, std::memory_order_release);
-    if (front_.compare_exchange_strong(front, new_front, std::memory_order_acq_rel)) {
-      size_.fetch_add(1, std::memory_order_acq_rel);
-      return ;
+template<typename T, typename R, typename A> template<typename InputIt>
+void LockFreeStack<T, R, A>::PushBulk(InputIt first, InputIt last) {
+  Data *top = nullptr;
+  Data *bottom = nullptr;
+  size_t count = 0;
+  // 某个元素构造失败时前面的节点都还在私有链表中, 全部释放后再抛出
+  try {
+    for (; first != last; ++first, ++count) {
+      auto *node = NewNode(*first);
+      node->next_.store(top, std::memory_order_relaxed);
+      top = node;
+      if (bottom == nullptr) {
+        bottom = node;
+      }
     }
+  } catch (...) {
+    FreeChain(top);
+    throw;
   }
+  if (count == 0) {
+    return ;
+  }
+  size_.fetch_add(count, std::memory_order_acq_rel);
+  while (!TryPush(top, bottom));
+  not_empty_.NotifyAll();
 }
 
-template<typename T>
-bool LockFreeStack<T>::Pop(T &data) {
+/*
+ * 从栈顶开始逐个保护后继节点, 每保护一个都确认 front_ 没有变化:
+ * 受保护的栈顶地址不会被复用, front_ 不变说明期间没有出栈, 已经读到的链表都还在栈中
+ */
+template<typename T, typename R, typename A> template<typename OutputIt>
+size_t LockFreeStack<T, R, A>::PopBulk(OutputIt out, size_t max) {
+  if (max == 0) {
+    return 0;
+  }
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point front_hp;
+  Point hps[2];
   Data *front;
-  Data *new_front;
-  HazardPoint hp;
-  do {
-    front = AcquireSafeNode(front_, hp);
-    if (front->next_.load(std::memory_order_acquire) == nullptr) {
-      return false;
+  size_t count;
+  for (;;) {
+    front = AcquireSafeNode(front_, front_hp);
+    auto *last = front;
+    bool valid = true;
+    for (count = 0; count < max; count++) {
+      auto *next = AcquireSafeNode(last->next_, hps[count & 1]);
+      if (front != front_.load(std::memory_order_acquire)) {
+        valid = false;
+        break;
+      }
+      // last 为栈底的哨兵
+      if (next == nullptr) {
+        break;
+      }
+      last = next;
     }
-    new_front = front->next_.load(std::memory_order_acquire);
-  } while (!front_.compare_exchange_strong(front, new_front, std::memory_order_acq_rel));
-  size_.fetch_sub(1, std::memory_order_acq_rel);
+    if (!valid) {
+      continue;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    if (front_.compare_exchange_strong(front, last, std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+  size_.fetch_sub(count, std::memory_order_acq_rel);
+  // 摘下的节点只有当前线程会退休, 不需要继续保护
+  auto *node = front;
+  for (size_t i = 0; i < count; i++) {
+    auto *next = node->next_.load(std::memory_order_acquire);
+    *out++ = std::move(node->value_.Get());
+    reclaimer.Retire(node);
+    node = next;
+  }
+  reclaimer.ReclaimNoHazard();
+  return count;
+}
 
-  data = std::forward<T>(*front->data_.load(std::memory_order_acquire));
-  auto &reclaimer = StackReclaimer<T>::GetInstance();
-  reclaimer.ReclaimLater(front, DeleteData);
+template<typename T, typename R, typename A>
+bool LockFreeStack<T, R, A>::Pop(T &data) {
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point hp;
+  Data *front;
+  PopResult result;
+  while ((result = TryPop(hp, &front)) == PopResult::Contended);
+  if (result == PopResult::Empty) {
+    return false;
+  }
+  FinishPop(reclaimer, front, data);
   return true;
 }
 
-template<typename T>
-LockFreeStack<T>::Data* LockFreeStack<T>::AcquireSafeNode(std::atomic<Data *> &atomic_node, HazardPoint &hp) {
-  auto &reclaimer = StackReclaimer<T>::GetInstance();
-  auto *node = atomic_node.load(std::memory_order_acquire);
-  Data *temp;
-  do {
-    hp.Unmark();
-    temp = node;
-    hp = HazardPoint(&reclaimer, node);
-    node = atomic_node.load(std::memory_order_acquire);
-  } while (temp != node);
-  return node;
+template<typename T, typename R, typename A>
+LockFreeStack<T, R, A>::Data* LockFreeStack<T, R, A>::AcquireSafeNode(std::atomic<Data *> &atomic_node, Point &hp) {
+  return GetReclaimer().Protect(atomic_node, hp);
 }
 }
 
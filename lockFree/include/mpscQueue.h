@@ -0,0 +1,164 @@
+#ifndef MPSCQUEUE_H_
+#define MPSCQUEUE_H_
+
+#include <atomic>
+#include <utility>
+#include <type_traits>
+
+#include "reclaim.h"
+#include "inlineValue.h"
+#include "slabAllocator.h"
+
+namespace lockFree {
+
+// 侵入式 MPSC 队列的链接字段, 元素类型继承 MpscHook
+struct MpscHook {
+  std::atomic<MpscHook*> next_{nullptr};
+};
+
+/*
+ * 多生产者单消费者的侵入式队列 (Vyukov), 队列不分配也不释放节点
+ * 入队只有一次 exchange 和一次 store, 是 wait-free 的; 出队只由一个消费者调用, 不需要 CAS
+ * 生产者只会写入自己 exchange 得到的前一个节点, 消费者只有在节点的 next_ 已经被写入之后才返回它,
+ * 此时不再有生产者访问这个节点, 所以消费者可以直接释放出队的节点, 不需要 hazard pointer
+ * 生产者在 exchange 和链接之间被挂起时, 之后的元素暂时不可见, Pop 返回 nullptr, 不会阻塞
+ */
+template<typename T>
+class IntrusiveMpscQueue {
+  static_assert(std::is_base_of_v<MpscHook, T>);
+ public:
+  IntrusiveMpscQueue() : head_(&stub_), tail_(&stub_) {}
+  ~ IntrusiveMpscQueue() = default;
+
+  // 任意线程调用
+  void Push(T *node) { Link(node); }
+
+  // 只能由消费者线程调用, 没有可见的元素时返回 nullptr
+  T* Pop();
+
+  // 只能由消费者线程调用
+  bool Empty() {
+    return head_ == &stub_ && stub_.next_.load(std::memory_order_acquire) == nullptr;
+  }
+
+  IntrusiveMpscQueue(const IntrusiveMpscQueue &other) = delete;
+  IntrusiveMpscQueue(IntrusiveMpscQueue &&other) = delete;
+  IntrusiveMpscQueue& operator = (const IntrusiveMpscQueue &other) = delete;
+  IntrusiveMpscQueue& operator = (IntrusiveMpscQueue &&other) = delete;
+
+ private:
+  void Link(MpscHook *node) {
+    node->next_.store(nullptr, std::memory_order_relaxed);
+    auto *prev = tail_.exchange(node, std::memory_order_acq_rel);
+    prev->next_.store(node, std::memory_order_release);
+  }
+
+  // 消费者的缓存行, stub_ 只在队列为空时作为占位节点
+  alignas(CacheLineSize) MpscHook *head_;
+  MpscHook stub_;
+  // 生产者的缓存行
+  alignas(CacheLineSize) std::atomic<MpscHook*> tail_;
+};
+
+template<typename T>
+T* IntrusiveMpscQueue<T>::Pop() {
+  auto *head = head_;
+  auto *next = head->next_.load(std::memory_order_acquire);
+  // 跳过 stub_
+  if (head == &stub_) {
+    if (next == nullptr) {
+      return nullptr;
+    }
+    head_ = next;
+    head = next;
+    next = next->next_.load(std::memory_order_acquire);
+  }
+  if (next != nullptr) {
+    head_ = next;
+    return static_cast<T*>(head);
+  }
+  // head 之后还有生产者正在链接
+  if (head != tail_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  // head 是最后一个节点, 重新放入 stub_ 之后才能把 head 取出
+  Link(&stub_);
+  next = head->next_.load(std::memory_order_acquire);
+  if (next != nullptr) {
+    head_ = next;
+    return static_cast<T*>(head);
+  }
+  return nullptr;
+}
+
+/*
+ * 非侵入式的 MPSC 队列, 元素保存在 IntrusiveMpscQueue 的节点中
+ * 节点默认从 SlabAllocator 分配: 消费者释放的节点先留在消费者线程的弹匣中, 攒满后整批回到仓库,
+ * 生产者从自己的弹匣取节点, 多数入队和出队都不会进入全局的 operator new / delete
+ */
+template<typename T, typename A = SlabAllocator<>>
+class MpscQueue {
+ public:
+  MpscQueue() = default;
+
+  ~ MpscQueue() {
+    while (auto *node = queue_.Pop()) {
+      delete node;
+    }
+  }
+
+  void Push(T &&data) { Emplace(std::move(data)); }
+
+  void Push(const T &data) { Emplace(data); }
+
+  // 只能由消费者线程调用
+  bool Pop(T &data) {
+    auto *node = queue_.Pop();
+    if (node == nullptr) {
+      return false;
+    }
+    data = std::move(node->value_.Get());
+    delete node;
+    return true;
+  }
+
+  // 只能由消费者线程调用
+  bool Empty() { return queue_.Empty(); }
+
+  MpscQueue(const MpscQueue &other) = delete;
+  MpscQueue(MpscQueue &&other) = delete;
+  MpscQueue& operator = (const MpscQueue &other) = delete;
+  MpscQueue& operator = (MpscQueue &&other) = delete;
+
+ private:
+  struct Node : public MpscHook, public AllocatedBy<A> {
+    Node() = default;
+    ~ Node() = default;
+
+    Node(const Node &other) = delete;
+    Node(Node &&other) = delete;
+    Node& operator = (const Node &other) = delete;
+    Node& operator = (Node &&other) = delete;
+
+    InlineValue<T> value_;
+  };
+
+  template<typename Arg>
+  void Emplace(Arg &&arg) {
+    auto *node = new Node();
+    // 元素构造失败时节点还没有入队, 直接释放
+    try {
+      node->value_.Construct(std::forward<Arg>(arg));
+    } catch (...) {
+      delete node;
+      throw;
+    }
+    queue_.Push(node);
+  }
+
+  IntrusiveMpscQueue<Node> queue_;
+};
+
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef MULTIQUEUE_H_
+#define MULTIQUEUE_H_
+
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <limits>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include "reclaim.h"
+
+namespace lockFree {
+
+constexpr size_t MultiQueueFactor = 2;
+
+constexpr int MultiQueueRetry = 16;
+
+/*
+ * 近似 FIFO 的 MultiQueue, 元素分散到 threads * factor 个分片中, 每个分片是一个由 try-lock 保护的 deque
+ * 入队时在分片的锁内打上时间戳, 分片内按时间戳有序; 出队随机取两个分片, 从队头时间戳较小的一个出队 (power of two choices)
+ * 锁被占用时换一个分片, 不在同一个锁上等待, 线程数增加时冲突分散到不同的分片上
+ * 顺序的松弛程度由两个参数控制:
+ *   factor      每个线程对应的分片数, 越大冲突越少, 出队的元素偏离全局队头越远
+ *   stickiness  同一个线程连续 stickiness 次操作使用同一个分片, 越大缓存局部性越好, 偏离也越大
+ * 多次采样都失败时逐个检查所有分片, Pop 返回 false 时所有分片在检查的时刻都为空
+ */
+template<typename T>
+class MultiQueue {
+ public:
+  explicit MultiQueue(size_t threads = std::thread::hardware_concurrency(), size_t factor = MultiQueueFactor,
+                      size_t stickiness = 1)
+      : count_(std::max<size_t>(std::max<size_t>(threads, 1) * std::max<size_t>(factor, 1), 2)),
+        stickiness_(std::max<size_t>(stickiness, 1)), shards_(new Shard[count_]), id_(NextId()) {}
+
+  ~ MultiQueue() = default;
+
+  void Push(T &&data) { Emplace(std::move(data)); }
+
+  void Push(const T &data) { Emplace(data); }
+
+  bool Pop(T &data);
+
+  // 并发修改时只是近似值
+  size_t Size() {
+    size_t size = 0;
+    for (size_t i = 0; i < count_; i++) {
+      size += shards_[i].size_.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+  size_t Shards() const { return count_; }
+
+  MultiQueue(const MultiQueue &other) = delete;
+  MultiQueue(MultiQueue &&other) = delete;
+  MultiQueue& operator = (const MultiQueue &other) = delete;
+  MultiQueue& operator = (MultiQueue &&other) = delete;
+
+ private:
+  static constexpr uint64_t EmptyStamp = std::numeric_limits<uint64_t>::max();
+
+  struct alignas(CacheLineSize) Shard {
+    bool TryLock() {
+      return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void Unlock() { locked_.store(false, std::memory_order_release); }
+
+    void Lock() {
+      while (!TryLock()) {
+        std::this_thread::yield();
+      }
+    }
+
+    // 只能在锁内调用
+    bool Take(T &data) {
+      if (items_.empty()) {
+        return false;
+      }
+      data = std::move(items_.front().second);
+      items_.pop_front();
+      top_.store(items_.empty() ? EmptyStamp : items_.front().first, std::memory_order_relaxed);
+      size_.store(items_.size(), std::memory_order_relaxed);
+      return true;
+    }
+
+    std::atomic<bool> locked_{false};
+    // 队头元素的时间戳, 出队采样时不加锁读取
+    std::atomic<uint64_t> top_{EmptyStamp};
+    std::atomic<size_t> size_{0};
+    std::deque<std::pair<uint64_t, T>> items_;
+  };
+
+  // 离开作用域时释放已经持有的分片锁, 元素的构造, 赋值或 deque 的分配抛出异常时锁也会被释放
+  class ShardGuard {
+   public:
+    explicit ShardGuard(Shard &shard) : shard_(shard) {}
+    ~ ShardGuard() { shard_.Unlock(); }
+
+    ShardGuard(const ShardGuard &other) = delete;
+    ShardGuard(ShardGuard &&other) = delete;
+    ShardGuard& operator = (const ShardGuard &other) = delete;
+    ShardGuard& operator = (ShardGuard &&other) = delete;
+
+   private:
+    Shard &shard_;
+  };
+
+  // 线程在当前队列上粘住的分片和剩余次数, 换了队列之后重新选择
+  // 按实例编号而不是地址区分队列, 同一地址上重新构造的队列不会用到旧队列的分片下标
+  struct Sticky {
+    uint64_t owner_{0};
+    size_t push_shard_{0};
+    size_t push_left_{0};
+    size_t pop_shard_{0};
+    size_t pop_left_{0};
+  };
+
+  template<typename Arg>
+  void Emplace(Arg &&arg);
+
+  Sticky& Local() {
+    thread_local Sticky sticky;
+    if (sticky.owner_ != id_) {
+      sticky = Sticky();
+      sticky.owner_ = id_;
+    }
+    return sticky;
+  }
+
+  size_t RandomShard() { return RandomNumber() % count_; }
+
+  static uint64_t NextId() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static uint32_t RandomNumber() {
+    // xorshift, 每个线程独立的种子
+    thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  static uint64_t Now() {
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+  }
+
+  const size_t count_;
+  const size_t stickiness_;
+  const std::unique_ptr<Shard[]> shards_;
+  const uint64_t id_;
+};
+
+template<typename T> template<typename Arg>
+void MultiQueue<T>::Emplace(Arg &&arg) {
+  auto &sticky = Local();
+  for (;;) {
+    auto index = sticky.push_left_ > 0 ? sticky.push_shard_ : RandomShard();
+    auto &shard = shards_[index];
+    if (!shard.TryLock()) {
+      sticky.push_left_ = 0;
+      continue;
+    }
+    {
+      ShardGuard guard(shard);
+      // 在锁内取时间戳, 同一个分片内的时间戳单调
+      auto stamp = Now();
+      shard.items_.emplace_back(stamp, std::forward<Arg>(arg));
+      if (shard.items_.size() == 1) {
+        shard.top_.store(stamp, std::memory_order_relaxed);
+      }
+      shard.size_.store(shard.items_.size(), std::memory_order_relaxed);
+    }
+    if (sticky.push_left_ > 0) {
+      sticky.push_left_--;
+    } else {
+      sticky.push_shard_ = index;
+      sticky.push_left_ = stickiness_ - 1;
+    }
+    return ;
+  }
+}
+
+template<typename T>
+bool MultiQueue<T>::Pop(T &data) {
+  auto &sticky = Local();
+  for (int i = 0; i < MultiQueueRetry; i++) {
+    size_t index;
+    if (sticky.pop_left_ > 0) {
+      index = sticky.pop_shard_;
+      sticky.pop_left_--;
+    } else {
+      auto a = RandomShard();
+      auto b = RandomShard();
+      index = shards_[a].top_.load(std::memory_order_relaxed) <= shards_[b].top_.load(std::memory_order_relaxed) ? a : b;
+      sticky.pop_shard_ = index;
+      sticky.pop_left_ = stickiness_ - 1;
+    }
+    auto &shard = shards_[index];
+    if (shard.top_.load(std::memory_order_relaxed) == EmptyStamp || !shard.TryLock()) {
+      sticky.pop_left_ = 0;
+      continue;
+    }
+    bool taken;
+    {
+      ShardGuard guard(shard);
+      taken = shard.Take(data);
+    }
+    if (taken) {
+      return true;
+    }
+    sticky.pop_left_ = 0;
+  }
+  // 采样多次都没有取到元素, 队列可能接近空, 逐个检查
+  for (size_t i = 0; i < count_; i++) {
+    auto &shard = shards_[i];
+    if (shard.size_.load(std::memory_order_acquire) == 0) {
+      continue;
+    }
+    shard.Lock();
+    bool taken;
+    {
+      ShardGuard guard(shard);
+      taken = shard.Take(data);
+    }
+    if (taken) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+#endif
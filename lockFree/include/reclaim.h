@@ -2,135 +2,433 @@
 #define RECLAIM_H_
 
 #include <vector>
+#include <memory>
 #include <atomic>
 #include <thread>
 #include <cassert>
 #include <iostream>
-#include <functional>
-#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
 
 namespace lockFree {
 
 /*
- * HazardPoint 和 HazardList 需要满足多线程安全
+ * HazardPoint 和 HazardDirectory 需要满足多线程安全
  */
 
-struct InternalHazardPoint {
-  InternalHazardPoint() : ptr_(nullptr), flag_(false), next_(nullptr) {}
-  ~ InternalHazardPoint() = default;
+constexpr size_t CacheLineSize = 64;
 
-  InternalHazardPoint(const InternalHazardPoint &other) = delete;
-  InternalHazardPoint(InternalHazardPoint &&other) = delete;
-  InternalHazardPoint& operator = (const InternalHazardPoint &other) = delete;
-  InternalHazardPoint& operator = (InternalHazardPoint &&other) = delete;
+constexpr size_t HazardBlockSlots = CacheLineSize / sizeof(void*);
 
-  std::atomic_flag flag_;
-  std::atomic<void*> ptr_;
-  std::atomic<InternalHazardPoint*> next_;
+/*
+ * 每个线程独占若干个 HazardBlock, 一个 block 的槽位恰好占满一条 cache line, 只由持有者写入,
+ * 持有标记和链表指针放在另一条 cache line 上, 发布 hazard 时不会和扫描线程或其他线程伪共享
+ */
+struct alignas(CacheLineSize) HazardBlock {
+  HazardBlock() : slots_{}, flag_(), next_(nullptr) {}
+  ~ HazardBlock() = default;
+
+  HazardBlock(const HazardBlock &other) = delete;
+  HazardBlock(HazardBlock &&other) = delete;
+  HazardBlock& operator = (const HazardBlock &other) = delete;
+  HazardBlock& operator = (HazardBlock &&other) = delete;
+
+  std::atomic<void*> slots_[HazardBlockSlots];
+  alignas(CacheLineSize) std::atomic_flag flag_;
+  std::atomic<HazardBlock*> next_;
 };
 
-struct HazardList {
-  HazardList() : size_(1), head_(new InternalHazardPoint()) {
+/*
+ * 定义 LOCKFREE_RECLAIM_STATS 时每个 Reclaimer 记录回收统计, 否则相关代码在编译期被去掉
+ */
+#ifdef LOCKFREE_RECLAIM_STATS
+constexpr bool ReclaimStatsEnabled = true;
+#else
+constexpr bool ReclaimStatsEnabled = false;
+#endif
+
+/*
+ * 每个线程独占一个 ReclaimCounter, 只由持有者写入, 其他线程可以随时读取。
+ * 计数只增不减, 线程退出后 counter 被后来的线程复用并继续累加
+ */
+struct alignas(CacheLineSize) ReclaimCounter {
+  ReclaimCounter() : retired_(0), freed_(0), scans_(0), scan_ns_(0), peak_backlog_(0), flag_(), next_(nullptr) {}
+  ~ ReclaimCounter() = default;
+
+  ReclaimCounter(const ReclaimCounter &other) = delete;
+  ReclaimCounter(ReclaimCounter &&other) = delete;
+  ReclaimCounter& operator = (const ReclaimCounter &other) = delete;
+  ReclaimCounter& operator = (ReclaimCounter &&other) = delete;
+
+  // 单写者, 不需要 read-modify-write
+  static void Add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
   }
 
-  ~ HazardList() {
+  static void Max(std::atomic<uint64_t> &counter, uint64_t value) {
+    if (value > counter.load(std::memory_order_relaxed)) {
+      counter.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t> retired_;
+  std::atomic<uint64_t> freed_;
+  std::atomic<uint64_t> scans_;
+  std::atomic<uint64_t> scan_ns_;
+  // 单个线程本地待删除节点数的峰值
+  std::atomic<uint64_t> peak_backlog_;
+  std::atomic_flag flag_;
+  std::atomic<ReclaimCounter*> next_;
+};
+
+/*
+ * HazardDomain::Stats 的结果, 各线程的计数不加锁地相加, 只是近似一致的快照。
+ * 未定义 LOCKFREE_RECLAIM_STATS 时只有 hazard 槽位和 orphan 数量有效
+ */
+struct ReclaimStats {
+  uint64_t retired_ = 0;
+  uint64_t freed_ = 0;
+  uint64_t scans_ = 0;
+  uint64_t scan_ns_ = 0;
+  // 已退休尚未删除的节点数, 包括交给 orphan list 和后台线程的节点
+  uint64_t backlog_ = 0;
+  // 所有线程中本地待删除节点数峰值的最大值
+  uint64_t peak_backlog_ = 0;
+  size_t hazard_slots_ = 0;
+  size_t hazard_in_use_ = 0;
+  size_t orphans_ = 0;
+};
+
+/*
+ * 所有 HazardBlock 注册在一个只增不减的无锁链表中, 线程退出时 block 被归还并由后来的线程复用
+ */
+struct HazardDirectory {
+  HazardDirectory() : size_(0), head_(nullptr), counters_(nullptr) {}
+
+  ~ HazardDirectory() {
     auto *p = head_.load(std::memory_order_acquire);
     while (p) {
       auto temp = p;
       p = p->next_.load(std::memory_order_acquire);
       delete temp;
     }
+    auto *c = counters_.load(std::memory_order_acquire);
+    while (c) {
+      auto temp = c;
+      c = c->next_.load(std::memory_order_acquire);
+      delete temp;
+    }
   }
 
+  // hazard 槽位的总数
   size_t Size() {
     return size_.load(std::memory_order_relaxed);
   }
 
-  HazardList(const HazardList &other) = delete;
-  HazardList(HazardList &&other) = delete;
-  HazardList& operator = (const HazardList &other) = delete;
-  HazardList& operator = (HazardList &&other) = delete;
+  HazardDirectory(const HazardDirectory &other) = delete;
+  HazardDirectory(HazardDirectory &&other) = delete;
+  HazardDirectory& operator = (const HazardDirectory &other) = delete;
+  HazardDirectory& operator = (HazardDirectory &&other) = delete;
 
   std::atomic<size_t> size_;
-  std::atomic<InternalHazardPoint*> head_;
+  std::atomic<HazardBlock*> head_;
+  // 只在启用统计时使用
+  std::atomic<ReclaimCounter*> counters_;
 };
 
 /*
- * ReclaimPoint 和 ReclaimPool 只需要满足单线程安全即可
+ * 删除函数为普通函数指针, context 为 ReclaimLater 时传入的附加参数, 不需要时为 0
+ */
+using DeleteFunction = void (*)(void *ptr, uintptr_t context);
+
+template<typename T>
+void DeleteObject(void *ptr, uintptr_t) {
+  delete static_cast<T*>(ptr);
+}
+
+/*
+ * ReclaimPoint 只需要满足单线程安全即可, 按值存放在每个线程自己的 retire vector 中
+ * size_ 为节点的字节数, 用于限制 domain 中尚未回收的内存, 未知时为 0
  */
 
 struct ReclaimPoint {
-  ReclaimPoint() : ptr_(nullptr), next_(nullptr), delete_function_(nullptr) {}
-  ~ ReclaimPoint() = default;
+  ReclaimPoint(void *ptr, DeleteFunction delete_function, uintptr_t context, size_t size)
+      : ptr_(ptr), delete_function_(delete_function), context_(context), size_(size) {}
 
-  ReclaimPoint(const ReclaimPoint &other) = delete;
-  ReclaimPoint(ReclaimPoint &&other) = delete;
-  ReclaimPoint& operator = (const ReclaimPoint &other) = delete;
-  ReclaimPoint& operator = (ReclaimPoint &&other) = delete;
+  void Reclaim() const { delete_function_(ptr_, context_); }
 
   void *ptr_;
-  ReclaimPoint *next_;
-  std::function<void(void*)> delete_function_;
+  DeleteFunction delete_function_;
+  uintptr_t context_;
+  size_t size_;
 };
 
-struct ReclaimPool {
-  ReclaimPool() : head_(new ReclaimPoint()) {}
+/*
+ * 退出的线程不再等待其他线程释放 hazard, 而是把尚未能删除的节点交给 domain 的 OrphanList,
+ * 由仍然存活的线程在下一次扫描时接管并删除。OrphanList 需要满足多线程安全
+ */
+class OrphanList {
+ public:
+  OrphanList() : head_(nullptr), size_(0) {}
+
+  // domain 析构时已经没有线程可以访问这些节点, 直接删除
+  ~ OrphanList();
 
-  ~ ReclaimPool() {
-    auto p = head_;
-    while (p) {
-      auto temp = p;
-      p = p->next_;
-      delete temp;
-    }
+  void Push(std::vector<ReclaimPoint> &&nodes);
+
+  // 取走全部孤儿节点, 追加到 nodes 末尾
+  bool TakeAll(std::vector<ReclaimPoint> &nodes);
+
+  size_t Size() {
+    return size_.load(std::memory_order_relaxed);
   }
 
-  void Push(ReclaimPoint *p) {
-    p->next_ = head_;
-    head_ = p;
+  OrphanList(const OrphanList &other) = delete;
+  OrphanList(OrphanList &&other) = delete;
+  OrphanList& operator = (const OrphanList &other) = delete;
+  OrphanList& operator = (OrphanList &&other) = delete;
+
+ private:
+  struct Batch {
+    explicit Batch(std::vector<ReclaimPoint> &&nodes) : nodes_(std::move(nodes)), next_(nullptr) {}
+
+    std::vector<ReclaimPoint> nodes_;
+    Batch *next_;
+  };
+
+  std::atomic<Batch*> head_;
+  std::atomic<size_t> size_;
+};
+
+/*
+ * 发布 hazard 时读线程需要 store 之后的一次 full fence, 保证扫描线程能看到 hazard。
+ * Asymmetric 模式下读线程只使用编译器屏障, 由扫描线程在收集 hazard 之前通过 membarrier
+ * 让所有线程执行一次 full fence。系统不支持 membarrier 时自动退回 Symmetric
+ */
+enum class HazardFence {
+  Symmetric,
+  Asymmetric,
+};
+
+/*
+ * 后台回收线程的参数:
+ * batch_size_ 为工作线程攒够多少个待删除节点后整批交给后台线程,
+ * wake_threshold_ 为后台积压的节点数达到多少时立即唤醒后台线程,
+ * interval_ 为未被唤醒时的定时扫描周期
+ */
+struct ReclaimServiceOptions {
+  size_t batch_size_ = 64;
+  size_t wake_threshold_ = 1024;
+  std::chrono::milliseconds interval_{10};
+};
+
+/*
+ * 达到上限时每次退避之前调用, attempt 从 0 开始递增, 可以据此逐级升级处理方式(记录日志, 报警, 终止进程等)
+ */
+using PressureCallback = void (*)(uintptr_t context, size_t nodes, size_t bytes, uint32_t attempt);
+
+/*
+ * domain 中尚未回收的节点数和字节数的上限, 为 0 时不限制。
+ * 超过上限时退休节点的线程先立即扫描一次, 仍然超过上限则逐级退避(先 yield, 再指数增长地 sleep),
+ * 最多等待 max_wait_ 后放弃, 不会无限期阻塞
+ * 字节数只统计退休对象本身的大小 (Retire 时的 sizeof(T)), 不包括对象在堆上另外持有的内存,
+ * 例如哈希表中 V 为 std::string 时只计入 sizeof(std::string)
+ */
+struct ReclaimLimit {
+  size_t max_nodes_ = 0;
+  size_t max_bytes_ = 0;
+  std::chrono::microseconds max_wait_{1000};
+  PressureCallback callback_ = nullptr;
+  uintptr_t callback_context_ = 0;
+
+  bool Enabled() const {
+    return max_nodes_ != 0 || max_bytes_ != 0;
   }
+};
 
-  ReclaimPoint* Pop() {
-    if (head_->next_ == nullptr) {
-      return new ReclaimPoint();
-    }
-    auto ans = head_;
-    head_ = head_->next_;
-    ans->next_ = nullptr;
-    return ans;
+class HazardDomain;
+
+/*
+ * 可选的后台回收服务, 工作线程只负责把退休的节点整批放入无锁的 pending_,
+ * 扫描 hazard 和删除节点全部由后台线程完成, Pop / Delete 不再承担扫描的开销
+ */
+class ReclaimService {
+ public:
+  ReclaimService(HazardDomain &domain, const ReclaimServiceOptions &options);
+
+  // 停止后台线程, 析构前会把 pending_ 中的节点再扫描一次
+  ~ ReclaimService();
+
+  void Start();
+
+  void Push(std::vector<ReclaimPoint> &&nodes);
+
+  // 取走尚未处理的节点, 追加到 nodes 末尾
+  bool TakeAll(std::vector<ReclaimPoint> &nodes) {
+    return pending_.TakeAll(nodes);
+  }
+
+  size_t BatchSize() const {
+    return options_.batch_size_;
   }
 
-  ReclaimPoint *head_;
+  size_t PendingSize() {
+    return pending_.Size();
+  }
+
+  ReclaimService(const ReclaimService &other) = delete;
+  ReclaimService(ReclaimService &&other) = delete;
+  ReclaimService& operator = (const ReclaimService &other) = delete;
+  ReclaimService& operator = (ReclaimService &&other) = delete;
+
+ private:
+  void Run();
+
+  HazardDomain &domain_;
+  const ReclaimServiceOptions options_;
+  OrphanList pending_;
+
+  // 唤醒只是提前扫描, 丢失的唤醒最多推迟一个 interval_, 工作线程不需要加锁
+  std::atomic<bool> notified_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+/*
+ * 一组共享 hazard pointer 的容器使用同一个 HazardDomain, 扫描时只需要遍历本 domain 的 hazard。
+ * 容器可以独占一个 domain, 也可以和其他容器共享, 默认情况下同类型的容器共享一个 domain
+ */
+class HazardDomain {
+ public:
+  explicit HazardDomain(HazardFence fence = HazardFence::Symmetric);
+
+  HazardDomain(HazardFence fence, const ReclaimLimit &limit);
+
+  // 启用后台回收线程, 该 domain 下的扫描全部由后台线程完成
+  HazardDomain(HazardFence fence, const ReclaimServiceOptions &options, const ReclaimLimit &limit = ReclaimLimit());
+
+  ~ HazardDomain() = default;
+
+  // 实际生效的模式, 构造之后不再改变
+  HazardFence Fence() const {
+    return fence_;
+  }
+
+  size_t Size() {
+    return directory_.Size();
+  }
+
+  size_t OrphanSize() {
+    return orphans_.Size();
+  }
+
+  // 不会阻塞其他线程, 可以在运行期间随时调用
+  ReclaimStats Stats();
+
+  // 未启用后台回收时为 nullptr
+  ReclaimService* Service() {
+    return service_.get();
+  }
+
+  const ReclaimLimit& Limit() const {
+    return limit_;
+  }
+
+  // 只在设置了上限时统计, 包括交给 orphan list 和后台线程的节点
+  size_t UnreclaimedNodes() {
+    return unreclaimed_nodes_.load(std::memory_order_relaxed);
+  }
+
+  size_t UnreclaimedBytes() {
+    return unreclaimed_bytes_.load(std::memory_order_relaxed);
+  }
+
+  bool OverLimit() {
+    return (limit_.max_nodes_ != 0 && UnreclaimedNodes() >= limit_.max_nodes_) ||
+           (limit_.max_bytes_ != 0 && UnreclaimedBytes() >= limit_.max_bytes_);
+  }
+
+  HazardDomain(const HazardDomain &other) = delete;
+  HazardDomain(HazardDomain &&other) = delete;
+  HazardDomain& operator = (const HazardDomain &other) = delete;
+  HazardDomain& operator = (HazardDomain &&other) = delete;
+
+  HazardDirectory directory_;
+  OrphanList orphans_;
+  std::atomic<size_t> unreclaimed_nodes_;
+  std::atomic<size_t> unreclaimed_bytes_;
+
+ private:
+  HazardFence fence_;
+  ReclaimLimit limit_;
+  // 需要先于 directory_ 和 orphans_ 析构
+  std::unique_ptr<ReclaimService> service_;
+};
+
+class HazardPoint;
+
+/*
+ * 容器的节点继承 R::NodeBase, hazard pointer 和 epoch 不需要在节点上记录信息, 空基类不占空间
+ */
+struct EmptyNodeBase {};
+
+/*
+ * hazard pointer 不需要进入临界区, Guard 为空操作, 仅用于和 EpochReclaimer 保持相同的接口
+ */
+template<typename R>
+class NoopGuard {
+ public:
+  explicit NoopGuard(R &) {}
+  ~ NoopGuard() = default;
+
+  NoopGuard(const NoopGuard &other) = delete;
+  NoopGuard(NoopGuard &&other) = delete;
+  NoopGuard& operator = (const NoopGuard &other) = delete;
+  NoopGuard& operator = (NoopGuard &&other) = delete;
 };
 
 class Reclaimer {
  public:
-  explicit Reclaimer(HazardList &global_hp_list) : global_hp_list_(global_hp_list) { }
-
-  virtual ~ Reclaimer() {
-    // 将当前持有的 local hazard point 归还到 global hazard list
-    for (auto it : local_hp_list_) {
-      assert(it->ptr_.load(std::memory_order_acquire) == nullptr);
-      it->flag_.clear(std::memory_order_release);
-    }
-    // 删除 待删除节点
-    for (auto it = reclaim_map_.begin(); it != reclaim_map_.end();) {
-      while (Hazard(it->second->ptr_)) {
-        std::this_thread::yield();
-      }
+  using Domain = HazardDomain;
+  using Point = HazardPoint;
+  using Guard = NoopGuard<Reclaimer>;
+  using NodeBase = EmptyNodeBase;
 
-      it->second->delete_function_(it->second->ptr_);
-      delete it->second;
-      it = reclaim_map_.erase(it);
+  explicit Reclaimer(HazardDomain &domain)
+      : domain_(domain), directory_(domain.directory_), service_(domain.Service()), counter_(nullptr),
+        asymmetric_(domain.Fence() == HazardFence::Asymmetric), limited_(domain.Limit().Enabled()) {
+    if constexpr (ReclaimStatsEnabled) {
+      RequireCounter();
     }
   }
 
+  // 归还 hazard point, 扫描一次后把仍被标记的节点交给 domain, 不会阻塞线程退出
+  virtual ~ Reclaimer();
+
   int32_t MarkHazard(void *ptr);
 
   void UnmarkHazard(int32_t index);
 
-  void ReclaimLater(void *ptr, std::function<void(void*)> &&delete_function);
+  // 读取 atomic_node 并标记为 hazard, 直到标记前后读到的值一致
+  template<typename N>
+  N* Protect(std::atomic<N*> &atomic_node, HazardPoint &hp);
+
+  void ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context = 0, size_t size = 0);
 
+  // 根据类型在编译期选择删除函数, 节点来自其他分配器时传入对应的删除函数
+  template<typename T>
+  void Retire(T *ptr, DeleteFunction delete_function = DeleteObject<T>) {
+    ReclaimLater(ptr, delete_function, 0, sizeof(T));
+  }
+
+  // 先接管其他线程退出时留下的节点, 待删除节点足够多时扫描一次;
+  // 启用后台回收时只把攒够的节点交给后台线程; domain 超过上限时立即扫描并退避
   void ReclaimNoHazard();
 
   Reclaimer() = delete;
@@ -140,16 +438,30 @@ class Reclaimer {
   Reclaimer& operator = (Reclaimer &&other) = delete;
 
  private:
+  friend class ReclaimService;
+
+  void Scan();
+
+  void RequireHazardBlock();
 
-  bool Hazard(void *ptr);
+  void RequireCounter();
 
-  void RequireHazardPoint();
+  void Backpressure();
 
-  std::vector<InternalHazardPoint*> local_hp_list_;
-  HazardList &global_hp_list_;
+  // 当前线程持有的 block 和所有槽位, free_slots_ 为空闲槽位的下标
+  std::vector<HazardBlock*> local_blocks_;
+  std::vector<std::atomic<void*>*> local_slots_;
+  std::vector<int32_t> free_slots_;
+  HazardDomain &domain_;
+  HazardDirectory &directory_;
+  ReclaimService *service_;
+  ReclaimCounter *counter_;
+  const bool asymmetric_;
+  const bool limited_;
 
-  ReclaimPool reclaim_pool_;
-  std::unordered_map<void*, ReclaimPoint*> reclaim_map_;
+  // 扫描时复用的 hazard 快照, 排序后二分查找, 稳定后不再分配内存
+  std::vector<void*> hazard_snapshot_;
+  std::vector<ReclaimPoint> reclaim_list_;
 
   static const size_t rate_ = 4;
 };
@@ -169,9 +481,11 @@ class HazardPoint {
     return index_;
   }
 
+  // 可以重复调用, 槽位只会归还一次
   void Unmark() {
     if (reclaimer_ != nullptr && index_ != -1) {
       reclaimer_->UnmarkHazard(index_);
+      index_ = -1;
     }
   }
 
@@ -194,6 +508,705 @@ class HazardPoint {
   Reclaimer *reclaimer_{};
 };
 
+template<typename N>
+N* Reclaimer::Protect(std::atomic<N*> &atomic_node, HazardPoint &hp) {
+  auto *node = atomic_node.load(std::memory_order_acquire);
+  N *temp;
+  do {
+    hp.Unmark();
+    temp = node;
+    hp = HazardPoint(this, node);
+    node = atomic_node.load(std::memory_order_acquire);
+  } while (temp != node);
+  return node;
+}
+
+/*
+ * Epoch-based reclamation:
+ * 读线程在一次操作的开始和结束各更新一次自己的 epoch, 访问节点时不再需要逐个发布 hazard pointer。
+ * 在 epoch e 退休的节点, 当全局 epoch 推进到 e + 2 时, 所有可能持有它的线程都已经离开临界区, 可以安全删除。
+ *
+ * EpochRecord 和 EpochDomain 需要满足多线程安全
+ */
+
+struct EpochRecord {
+  EpochRecord() : flag_(), epoch_(0), next_(nullptr) {}
+  ~ EpochRecord() = default;
+
+  EpochRecord(const EpochRecord &other) = delete;
+  EpochRecord(EpochRecord &&other) = delete;
+  EpochRecord& operator = (const EpochRecord &other) = delete;
+  EpochRecord& operator = (EpochRecord &&other) = delete;
+
+  // 最低位表示是否处于临界区, 其余位为进入临界区时观察到的全局 epoch
+  static bool Active(uint64_t epoch) { return (epoch & 1) == 1; }
+
+  std::atomic_flag flag_;
+  std::atomic<uint64_t> epoch_;
+  std::atomic<EpochRecord*> next_;
+};
+
+struct EpochDomain {
+  EpochDomain() : epoch_(0), size_(0), head_(nullptr) {}
+
+  ~ EpochDomain() {
+    auto *p = head_.load(std::memory_order_acquire);
+    while (p) {
+      auto temp = p;
+      p = p->next_.load(std::memory_order_acquire);
+      delete temp;
+    }
+  }
+
+  size_t Size() {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  EpochDomain(const EpochDomain &other) = delete;
+  EpochDomain(EpochDomain &&other) = delete;
+  EpochDomain& operator = (const EpochDomain &other) = delete;
+  EpochDomain& operator = (EpochDomain &&other) = delete;
+
+  size_t OrphanSize() {
+    return orphans_.Size();
+  }
+
+  std::atomic<uint64_t> epoch_;
+  std::atomic<size_t> size_;
+  std::atomic<EpochRecord*> head_;
+  OrphanList orphans_;
+};
+
+class EpochReclaimer;
+
+// epoch 和 QSBR 模式下节点由临界区整体保护, EpochPoint 不做任何事情
+class EpochPoint {
+ public:
+  EpochPoint() = default;
+
+  template<typename R>
+  EpochPoint(R *, void *) {}
+
+  ~ EpochPoint() = default;
+
+  int32_t Index() const {
+    return -1;
+  }
+
+  void Unmark() {}
+
+  EpochPoint(const EpochPoint &other) = delete;
+  EpochPoint& operator = (const EpochPoint &other) = delete;
+
+  EpochPoint(EpochPoint &&other) noexcept = default;
+  EpochPoint& operator = (EpochPoint &&other) noexcept = default;
+};
+
+class EpochGuard;
+
+class EpochReclaimer {
+ public:
+  using Domain = EpochDomain;
+  using Point = EpochPoint;
+  using Guard = EpochGuard;
+  using NodeBase = EmptyNodeBase;
+
+  explicit EpochReclaimer(EpochDomain &domain);
+
+  virtual ~ EpochReclaimer();
+
+  // 支持嵌套, 只有最外层的 Enter / Exit 会发布 epoch
+  void Enter();
+
+  void Exit();
+
+  template<typename N>
+  N* Protect(std::atomic<N*> &atomic_node, EpochPoint &) {
+    return atomic_node.load(std::memory_order_acquire);
+  }
+
+  void ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context = 0, size_t size = 0);
+
+  // 根据类型在编译期选择删除函数, 节点来自其他分配器时传入对应的删除函数
+  template<typename T>
+  void Retire(T *ptr, DeleteFunction delete_function = DeleteObject<T>) {
+    ReclaimLater(ptr, delete_function, 0, sizeof(T));
+  }
+
+  void ReclaimNoHazard();
+
+  EpochReclaimer() = delete;
+  EpochReclaimer(const EpochReclaimer &other) = delete;
+  EpochReclaimer(EpochReclaimer &&other) = delete;
+  EpochReclaimer& operator = (const EpochReclaimer &other) = delete;
+  EpochReclaimer& operator = (EpochReclaimer &&other) = delete;
+
+ private:
+  // 所有处于临界区的线程都已经观察到当前 epoch 时, 将全局 epoch 加一
+  bool TryAdvance();
+
+  // 删除所有退休 epoch 不晚于 safe_epoch 的节点
+  void ReclaimBefore(uint64_t safe_epoch);
+
+  void FreeLimbo(size_t index);
+
+  void RequireEpochRecord();
+
+  void AdoptOrphans();
+
+  EpochDomain &domain_;
+  EpochRecord *record_;
+  uint32_t depth_;
+
+  // 按 epoch % 3 分桶的待删除节点
+  std::vector<ReclaimPoint> limbo_[3];
+  uint64_t limbo_epoch_[3];
+  size_t limbo_size_;
+  std::vector<ReclaimPoint> adopted_;
+
+  static const size_t threshold_ = 64;
+};
+
+class EpochGuard {
+ public:
+  explicit EpochGuard(EpochReclaimer &reclaimer) : reclaimer_(reclaimer) {
+    reclaimer_.Enter();
+  }
+
+  ~ EpochGuard() {
+    reclaimer_.Exit();
+  }
+
+  EpochGuard(const EpochGuard &other) = delete;
+  EpochGuard(EpochGuard &&other) = delete;
+  EpochGuard& operator = (const EpochGuard &other) = delete;
+  EpochGuard& operator = (EpochGuard &&other) = delete;
+
+ private:
+  EpochReclaimer &reclaimer_;
+};
+
+/*
+ * Hazard eras:
+ * 每个节点记录创建时的全局 era (birth), 退休时记录当时的 era (retire)。读线程不再发布节点的地址,
+ * 而是发布访问节点时观察到的 era, 一个节点只有在某个线程发布的 era 落在 [birth, retire] 之间时才不能删除。
+ * 全局 era 不变时重复的 Protect 不需要再执行 fence, 发布开销接近 epoch;
+ * 停住的读线程只会保留在它发布的 era 时仍然存活的节点, 未回收的内存和 hazard pointer 一样有上界。
+ *
+ * EraBlock 和 EraDomain 需要满足多线程安全
+ */
+
+// 0 表示槽位未发布 era, 全局 era 从 1 开始
+constexpr uint64_t NoneEra = 0;
+
+constexpr size_t EraBlockSlots = CacheLineSize / sizeof(uint64_t);
+
+struct alignas(CacheLineSize) EraBlock {
+  EraBlock() : slots_{}, flag_(), next_(nullptr) {}
+  ~ EraBlock() = default;
+
+  EraBlock(const EraBlock &other) = delete;
+  EraBlock(EraBlock &&other) = delete;
+  EraBlock& operator = (const EraBlock &other) = delete;
+  EraBlock& operator = (EraBlock &&other) = delete;
+
+  std::atomic<uint64_t> slots_[EraBlockSlots];
+  alignas(CacheLineSize) std::atomic_flag flag_;
+  std::atomic<EraBlock*> next_;
+};
+
+/*
+ * 每个 domain 有自己的 era 时钟, 一个 domain 的扫描不会让其他 domain 的读线程重新发布 era
+ * 节点的 birth era 由容器在节点发布之前调用 StampBirth 从所属 domain 读取
+ */
+struct EraDomain {
+  EraDomain() : clock_(1), size_(0), head_(nullptr) {}
+
+  ~ EraDomain() {
+    auto *p = head_.load(std::memory_order_acquire);
+    while (p) {
+      auto temp = p;
+      p = p->next_.load(std::memory_order_acquire);
+      delete temp;
+    }
+  }
+
+  uint64_t CurrentEra() {
+    return clock_.load(std::memory_order_acquire);
+  }
+
+  size_t Size() {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  size_t OrphanSize() {
+    return orphans_.Size();
+  }
+
+  EraDomain(const EraDomain &other) = delete;
+  EraDomain(EraDomain &&other) = delete;
+  EraDomain& operator = (const EraDomain &other) = delete;
+  EraDomain& operator = (EraDomain &&other) = delete;
+
+  std::atomic<uint64_t> clock_;
+  std::atomic<size_t> size_;
+  std::atomic<EraBlock*> head_;
+  OrphanList orphans_;
+};
+
+// 没有调用 StampBirth 的节点和没有继承 EraNode 的类型按 birth 为 0 处理, 只是回收得更保守
+struct EraNode {
+  EraNode() : birth_era_(NoneEra) {}
+
+  uint64_t birth_era_;
+};
+
+// 节点发布之前记录所属 domain 的当前 era, 其他回收策略的 NodeBase 为空, 调用没有开销
+template<typename N, typename D>
+void StampBirth(N *node, D &domain) {
+  if constexpr (std::is_base_of_v<EraNode, N>) {
+    node->birth_era_ = domain.CurrentEra();
+  }
+}
+
+class EraReclaimer;
+
+class EraPoint {
+ public:
+  EraPoint() : index_(-1), reclaimer_(nullptr) {}
+
+  // 占用一个槽位并发布当前 era, 之后需要像 hazard pointer 一样重新确认 ptr 仍然可达
+  EraPoint(EraReclaimer *reclaimer, void *ptr);
+
+  ~ EraPoint() {
+    Unmark();
+  }
+
+  int32_t Index() const {
+    return index_;
+  }
+
+  void Unmark();
+
+  EraPoint(const EraPoint &other) = delete;
+  EraPoint& operator = (const EraPoint &other) = delete;
+
+  EraPoint(EraPoint &&other) noexcept : index_(-1), reclaimer_(nullptr) {
+    *this = std::move(other);
+  }
+
+  EraPoint& operator = (EraPoint &&other) noexcept {
+    this->reclaimer_ = other.reclaimer_;
+    this->index_ = other.index_;
+    other.index_ = -1;
+    return *this;
+  }
+
+ private:
+  friend class EraReclaimer;
+
+  int32_t index_;
+  EraReclaimer *reclaimer_;
+};
+
+class EraGuard;
+
+class EraReclaimer {
+ public:
+  using Domain = EraDomain;
+  using Point = EraPoint;
+  using Guard = EraGuard;
+  using NodeBase = EraNode;
+
+  explicit EraReclaimer(EraDomain &domain);
+
+  virtual ~ EraReclaimer();
+
+  // 支持嵌套, 最外层的 Exit 清空本线程发布的所有 era
+  void Enter() {
+    depth_++;
+  }
+
+  void Exit();
+
+  // 槽位在 Unmark 之后保留已经发布的 era, 直到 Exit, 同一次操作中 era 不变时不需要 fence
+  int32_t AcquireSlot();
+
+  void ReleaseSlot(int32_t index);
+
+  // 在槽位上发布当前 era, 返回发布的 era
+  uint64_t PublishEra(int32_t index);
+
+  // 读取 atomic_node, 直到读取前后全局 era 不变并且已经发布
+  template<typename N>
+  N* Protect(std::atomic<N*> &atomic_node, EraPoint &point);
+
+  void ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context = 0, size_t size = 0) {
+    RetireEra(ReclaimPoint(ptr, delete_function, context, size), NoneEra);
+  }
+
+  template<typename T>
+  void Retire(T *ptr, DeleteFunction delete_function = DeleteObject<T>) {
+    uint64_t birth = NoneEra;
+    if constexpr (std::is_base_of_v<EraNode, T>) {
+      birth = static_cast<const EraNode*>(ptr)->birth_era_;
+    }
+    RetireEra(ReclaimPoint(ptr, delete_function, 0, sizeof(T)), birth);
+  }
+
+  void ReclaimNoHazard();
+
+  EraReclaimer() = delete;
+  EraReclaimer(const EraReclaimer &other) = delete;
+  EraReclaimer(EraReclaimer &&other) = delete;
+  EraReclaimer& operator = (const EraReclaimer &other) = delete;
+  EraReclaimer& operator = (EraReclaimer &&other) = delete;
+
+ private:
+  struct Retired {
+    Retired(const ReclaimPoint &point, uint64_t birth, uint64_t retire)
+        : point_(point), birth_(birth), retire_(retire) {}
+
+    ReclaimPoint point_;
+    uint64_t birth_;
+    uint64_t retire_;
+  };
+
+  void RetireEra(const ReclaimPoint &point, uint64_t birth);
+
+  void Scan();
+
+  void RequireEraBlock();
+
+  std::vector<EraBlock*> local_blocks_;
+  std::vector<std::atomic<uint64_t>*> local_slots_;
+  std::vector<int32_t> free_slots_;
+  EraDomain &domain_;
+  uint32_t depth_;
+
+  std::vector<uint64_t> era_snapshot_;
+  std::vector<Retired> reclaim_list_;
+  std::vector<ReclaimPoint> adopted_;
+  // 上一次扫描之后仍被保护的节点数
+  size_t pinned_;
+
+  static const size_t rate_ = 4;
+};
+
+// 每次访问节点都会调用, 放在头文件中以便内联
+inline int32_t EraReclaimer::AcquireSlot() {
+  if (free_slots_.empty()) {
+    RequireEraBlock();
+  }
+  auto index = free_slots_.back();
+  free_slots_.pop_back();
+  return index;
+}
+
+inline void EraReclaimer::ReleaseSlot(int32_t index) {
+  assert(0 <= index && static_cast<size_t>(index) < local_slots_.size());
+  free_slots_.push_back(index);
+}
+
+inline uint64_t EraReclaimer::PublishEra(int32_t index) {
+  auto &slot = *local_slots_[index];
+  auto era = domain_.CurrentEra();
+  if (slot.load(std::memory_order_relaxed) != era) {
+    slot.store(era, std::memory_order_relaxed);
+    // 之后对源指针的重新读取不能早于 era 的发布
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  return era;
+}
+
+inline EraPoint::EraPoint(EraReclaimer *reclaimer, void *ptr) : index_(-1), reclaimer_(reclaimer) {
+  if (ptr == nullptr) {
+    return ;
+  }
+  index_ = reclaimer_->AcquireSlot();
+  reclaimer_->PublishEra(index_);
+}
+
+inline void EraPoint::Unmark() {
+  if (reclaimer_ != nullptr && index_ != -1) {
+    reclaimer_->ReleaseSlot(index_);
+    index_ = -1;
+  }
+}
+
+template<typename N>
+N* EraReclaimer::Protect(std::atomic<N*> &atomic_node, EraPoint &point) {
+  if (point.index_ == -1) {
+    point.reclaimer_ = this;
+    point.index_ = AcquireSlot();
+  }
+  auto &slot = *local_slots_[point.index_];
+  auto published = slot.load(std::memory_order_relaxed);
+  for (;;) {
+    auto *node = atomic_node.load(std::memory_order_acquire);
+    auto era = domain_.CurrentEra();
+    if (era == published) {
+      return node;
+    }
+    published = PublishEra(point.index_);
+  }
+}
+
+class EraGuard {
+ public:
+  explicit EraGuard(EraReclaimer &reclaimer) : reclaimer_(reclaimer) {
+    reclaimer_.Enter();
+  }
+
+  ~ EraGuard() {
+    reclaimer_.Exit();
+  }
+
+  EraGuard(const EraGuard &other) = delete;
+  EraGuard(EraGuard &&other) = delete;
+  EraGuard& operator = (const EraGuard &other) = delete;
+  EraGuard& operator = (EraGuard &&other) = delete;
+
+ private:
+  EraReclaimer &reclaimer_;
+};
+
+/*
+ * Quiescent-state-based reclamation:
+ * 线程在两次操作之间(例如线程池的两个任务之间)不持有任何节点, 称为静止状态。
+ * 读线程访问节点时没有任何开销, 只需要在静止时调用 QsbrQuiescent 宣告一次,
+ * 长时间空闲之前调用 QsbrOffline 退出, 之后第一次操作时自动重新上线。
+ * 在 epoch e 打包的节点, 当所有在线线程宣告静止时观察到的 epoch 都不小于 e 时可以安全删除。
+ * 线程池的工作线程会在每个任务之后自动宣告, 其他线程使用 QSBR 容器时需要自己周期性地调用
+ * 线程池之外的线程只要访问过 QSBR 容器就处于在线状态, 在它调用 QsbrQuiescent 或 QsbrOffline 之前,
+ * 这个 domain 中所有之后退休的节点都不会被删除
+ *
+ * QsbrRecord 和 QsbrDomain 需要满足多线程安全
+ */
+
+struct QsbrRecord {
+  QsbrRecord() : flag_(), quiescent_(Offline), next_(nullptr) {}
+  ~ QsbrRecord() = default;
+
+  QsbrRecord(const QsbrRecord &other) = delete;
+  QsbrRecord(QsbrRecord &&other) = delete;
+  QsbrRecord& operator = (const QsbrRecord &other) = delete;
+  QsbrRecord& operator = (QsbrRecord &&other) = delete;
+
+  // 离线的线程不会阻止任何节点的删除
+  static constexpr uint64_t Offline = UINT64_MAX;
+
+  std::atomic_flag flag_;
+  std::atomic<uint64_t> quiescent_;
+  std::atomic<QsbrRecord*> next_;
+};
+
+struct QsbrDomain {
+  QsbrDomain() : epoch_(1), size_(0), head_(nullptr) {}
+
+  ~ QsbrDomain() {
+    auto *p = head_.load(std::memory_order_acquire);
+    while (p) {
+      auto temp = p;
+      p = p->next_.load(std::memory_order_acquire);
+      delete temp;
+    }
+  }
+
+  size_t Size() {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  size_t OrphanSize() {
+    return orphans_.Size();
+  }
+
+  QsbrDomain(const QsbrDomain &other) = delete;
+  QsbrDomain(QsbrDomain &&other) = delete;
+  QsbrDomain& operator = (const QsbrDomain &other) = delete;
+  QsbrDomain& operator = (QsbrDomain &&other) = delete;
+
+  std::atomic<uint64_t> epoch_;
+  std::atomic<size_t> size_;
+  std::atomic<QsbrRecord*> head_;
+  OrphanList orphans_;
+};
+
+class QsbrGuard;
+
+class QsbrReclaimer {
+ public:
+  using Domain = QsbrDomain;
+  using Point = EpochPoint;
+  using Guard = QsbrGuard;
+  using NodeBase = EmptyNodeBase;
+
+  explicit QsbrReclaimer(QsbrDomain &domain);
+
+  virtual ~ QsbrReclaimer();
+
+  // 离线之后的第一次操作需要重新上线, 否则只是一次判断
+  void Enter() {
+    if (!online_) {
+      Online();
+    }
+  }
+
+  // 当前线程不再持有任何节点, 离线时不需要宣告
+  void Quiescent() {
+    if (online_) {
+      record_->quiescent_.store(domain_.epoch_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+  }
+
+  void Offline();
+
+  template<typename N>
+  N* Protect(std::atomic<N*> &atomic_node, EpochPoint &) {
+    return atomic_node.load(std::memory_order_acquire);
+  }
+
+  void ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context = 0, size_t size = 0) {
+    pending_.emplace_back(ptr, delete_function, context, size);
+  }
+
+  template<typename T>
+  void Retire(T *ptr, DeleteFunction delete_function = DeleteObject<T>) {
+    ReclaimLater(ptr, delete_function, 0, sizeof(T));
+  }
+
+  void ReclaimNoHazard();
+
+  QsbrReclaimer() = delete;
+  QsbrReclaimer(const QsbrReclaimer &other) = delete;
+  QsbrReclaimer(QsbrReclaimer &&other) = delete;
+  QsbrReclaimer& operator = (const QsbrReclaimer &other) = delete;
+  QsbrReclaimer& operator = (QsbrReclaimer &&other) = delete;
+
+ private:
+  struct Batch {
+    Batch(uint64_t epoch, std::vector<ReclaimPoint> &&nodes) : epoch_(epoch), nodes_(std::move(nodes)) {}
+
+    uint64_t epoch_;
+    std::vector<ReclaimPoint> nodes_;
+  };
+
+  void Online();
+
+  // 所有在线线程宣告过的最小 epoch
+  uint64_t MinQuiescent();
+
+  void FreeBatches(uint64_t safe_epoch);
+
+  void RequireQsbrRecord();
+
+  QsbrDomain &domain_;
+  QsbrRecord *record_;
+  bool online_;
+
+  std::vector<ReclaimPoint> pending_;
+  // 按 epoch 递增排列
+  std::vector<Batch> batches_;
+
+  static const size_t threshold_ = 64;
+};
+
+class QsbrGuard {
+ public:
+  explicit QsbrGuard(QsbrReclaimer &reclaimer) {
+    reclaimer.Enter();
+  }
+
+  ~ QsbrGuard() = default;
+
+  QsbrGuard(const QsbrGuard &other) = delete;
+  QsbrGuard(QsbrGuard &&other) = delete;
+  QsbrGuard& operator = (const QsbrGuard &other) = delete;
+  QsbrGuard& operator = (QsbrGuard &&other) = delete;
+};
+
+/*
+ * 每个线程为每个 domain 持有一个 R 类型的 reclaimer, 以 domain 为 key 保存在 thread_local 中。
+ * reclaimer 持有 domain 的引用计数, 当某个 domain 只剩当前线程引用时(容器已经析构), 回收对应的 reclaimer
+ */
+template<typename R>
+class ReclaimerRegistry {
+  using Domain = typename R::Domain;
+
+ public:
+  static R& GetInstance(const std::shared_ptr<Domain> &domain) {
+    return Local().Get(domain);
+  }
+
+  // 依次访问当前线程持有的所有 reclaimer
+  template<typename F>
+  static void ForEach(F &&f) {
+    for (auto &it : Local().entries_) {
+      f(*it.reclaimer_);
+    }
+  }
+
+  ~ ReclaimerRegistry() = default;
+
+  ReclaimerRegistry(const ReclaimerRegistry &other) = delete;
+  ReclaimerRegistry(ReclaimerRegistry &&other) = delete;
+  ReclaimerRegistry& operator = (const ReclaimerRegistry &other) = delete;
+  ReclaimerRegistry& operator = (ReclaimerRegistry &&other) = delete;
+
+ private:
+  struct Entry {
+    explicit Entry(const std::shared_ptr<Domain> &domain)
+        : domain_(domain), reclaimer_(std::make_unique<R>(*domain)) {}
+
+    // reclaimer_ 需要先于 domain_ 析构
+    std::shared_ptr<Domain> domain_;
+    std::unique_ptr<R> reclaimer_;
+  };
+
+  ReclaimerRegistry() : last_domain_(nullptr), last_reclaimer_(nullptr) {}
+
+  static ReclaimerRegistry& Local() {
+    thread_local ReclaimerRegistry registry;
+    return registry;
+  }
+
+  R& Get(const std::shared_ptr<Domain> &domain) {
+    if (domain.get() == last_domain_) {
+      return *last_reclaimer_;
+    }
+    Entry *entry = nullptr;
+    for (auto &it : entries_) {
+      if (it.domain_ == domain) {
+        entry = &it;
+        break;
+      }
+    }
+    if (entry == nullptr) {
+      Prune();
+      entry = &entries_.emplace_back(domain);
+    }
+    last_domain_ = entry->domain_.get();
+    last_reclaimer_ = entry->reclaimer_.get();
+    return *last_reclaimer_;
+  }
+
+  void Prune() {
+    std::erase_if(entries_, [](const Entry &entry) {
+      return entry.domain_.use_count() == 1;
+    });
+  }
+
+  Domain *last_domain_;
+  R *last_reclaimer_;
+  std::vector<Entry> entries_;
+};
+
+// 当前线程对自己持有的所有 QSBR reclaimer 宣告静止, 由线程池在每个任务之后调用
+void QsbrQuiescent();
+
+// 当前线程即将长时间空闲, 不再阻止其他线程删除节点
+void QsbrOffline();
+
 }
 
 #endif
@@ -0,0 +1,228 @@
+#ifndef SEGMENTQUEUE_H_
+#define SEGMENTQUEUE_H_
+
+#include <new>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+
+#include "reclaim.h"
+#include "inlineValue.h"
+
+namespace lockFree {
+
+constexpr size_t SegmentSize = 1024;
+
+/*
+ * 由环形段 (segment) 链接而成的无界队列, 入队和出队用 fetch_add 在段内领取下标, 不在 CAS 上重试
+ * 每个下标只会被一个入队线程和一个出队线程领取, 槽的状态只有 Empty -> Ready -> Taken 和 Empty -> Taken 两条路径:
+ *   入队线程先把元素写入槽中再 CAS Empty -> Ready, 失败说明出队线程已经放弃了这个槽, 取回元素换下一个下标
+ *   出队线程 exchange 为 Taken, 原来是 Ready 时取走元素, 是 Empty 时换下一个下标
+ * 段用完之后追加新的段, 出队越过整个段之后通过 R 退休旧段
+ * R 为回收策略, 段继承 R::NodeBase, 不指定 domain 时使用同类型队列共享的默认 domain
+ */
+template<typename T, typename R = Reclaimer>
+class SegmentQueue {
+ public:
+  using Domain = typename R::Domain;
+
+  SegmentQueue() : SegmentQueue(DefaultDomain()) {}
+
+  explicit SegmentQueue(std::shared_ptr<Domain> domain)
+      : domain_(std::move(domain)), head_(new Segment()), tail_(head_.load(std::memory_order_relaxed)), size_(0) {}
+
+  ~ SegmentQueue() {
+    auto *p = head_.load(std::memory_order_acquire);
+    while (p) {
+      auto temp = p;
+      p = p->next_.load(std::memory_order_acquire);
+      delete temp;
+    }
+  }
+
+  void Push(T &&data) { Emplace(std::move(data)); }
+
+  void Push(const T &data) { Emplace(data); }
+
+  bool Pop(T &data);
+
+  size_t Size() {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  static size_t Global_Size() {
+    return DefaultDomain()->Size();
+  }
+
+  static std::shared_ptr<Domain> DefaultDomain() {
+    static auto domain = std::make_shared<Domain>();
+    return domain;
+  }
+
+  const std::shared_ptr<Domain>& GetDomain() const {
+    return domain_;
+  }
+
+  SegmentQueue(const SegmentQueue &other) = delete;
+  SegmentQueue(SegmentQueue &&other) = delete;
+  SegmentQueue& operator = (const SegmentQueue &other) = delete;
+  SegmentQueue& operator = (SegmentQueue &&other) = delete;
+
+ private:
+  using Point = typename R::Point;
+  using Guard = typename R::Guard;
+
+  enum SlotState : uint32_t { Empty, Ready, Taken };
+
+  struct Slot {
+    T& Get() { return *std::launder(reinterpret_cast<T*>(storage_)); }
+
+    std::atomic<uint32_t> state_{Empty};
+    alignas(T) unsigned char storage_[sizeof(T)];
+  };
+
+  struct Segment : public R::NodeBase {
+    Segment() : enqueue_(0), dequeue_(0), next_(nullptr) {}
+
+    // 只有入队成功且没有被取走的元素需要析构
+    ~ Segment() {
+      for (auto &slot : slots_) {
+        if (slot.state_.load(std::memory_order_acquire) == Ready) {
+          slot.Get().~T();
+        }
+      }
+    }
+
+    Segment(const Segment &other) = delete;
+    Segment(Segment &&other) = delete;
+    Segment& operator = (const Segment &other) = delete;
+    Segment& operator = (Segment &&other) = delete;
+
+    alignas(CacheLineSize) std::atomic<size_t> enqueue_;
+    alignas(CacheLineSize) std::atomic<size_t> dequeue_;
+    alignas(CacheLineSize) std::atomic<Segment*> next_;
+    Slot slots_[SegmentSize];
+  };
+
+  template<typename Arg>
+  void Emplace(Arg &&arg);
+
+  R& GetReclaimer() { return ReclaimerRegistry<R>::GetInstance(domain_); }
+
+
+  std::shared_ptr<Domain> domain_;
+  alignas(CacheLineSize) std::atomic<Segment*> head_;
+  alignas(CacheLineSize) std::atomic<Segment*> tail_;
+  alignas(CacheLineSize) std::atomic<size_t> size_;
+};
+
+/*
+ * 第一次尝试直接在槽中构造元素, 槽被出队线程放弃后把元素移到本地, 之后的尝试从本地移动构造
+ */
+template<typename T, typename R> template<typename Arg>
+void SegmentQueue<T, R>::Emplace(Arg &&arg) {
+  // 先计数再写入, Size 不会因为出队早于计数而下溢
+  size_.fetch_add(1, std::memory_order_acq_rel);
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point hp;
+  InlineValue<T> local;
+  bool moved = false;
+  auto take_back = [&local, &moved](Slot &slot) {
+    if (moved) {
+      local.Get() = std::move(slot.Get());
+    } else {
+      local.Construct(std::move(slot.Get()));
+      moved = true;
+    }
+    slot.Get().~T();
+  };
+  auto construct = [&local, &moved, &arg](Slot &slot) {
+    if (moved) {
+      new (slot.storage_) T(std::move(local.Get()));
+    } else {
+      new (slot.storage_) T(std::forward<Arg>(arg));
+    }
+  };
+
+  for (;;) {
+    auto *tail = reclaimer.Protect(tail_, hp);
+    auto index = tail->enqueue_.fetch_add(1, std::memory_order_acq_rel);
+    if (index < SegmentSize) {
+      auto &slot = tail->slots_[index];
+      construct(slot);
+      uint32_t expected = Empty;
+      if (slot.state_.compare_exchange_strong(expected, Ready, std::memory_order_release, std::memory_order_relaxed)) {
+        return ;
+      }
+      take_back(slot);
+      continue;
+    }
+    // 当前段已经用完
+    if (tail != tail_.load(std::memory_order_acquire)) {
+      continue;
+    }
+    auto *next = tail->next_.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+      continue;
+    }
+    // 新段的第一个槽直接放入元素
+    auto *segment = new Segment();
+    StampBirth(segment, *domain_);
+    construct(segment->slots_[0]);
+    segment->slots_[0].state_.store(Ready, std::memory_order_relaxed);
+    segment->enqueue_.store(1, std::memory_order_relaxed);
+    if (tail->next_.compare_exchange_strong(next, segment, std::memory_order_acq_rel)) {
+      tail_.compare_exchange_strong(tail, segment, std::memory_order_acq_rel);
+      return ;
+    }
+    take_back(segment->slots_[0]);
+    segment->slots_[0].state_.store(Taken, std::memory_order_relaxed);
+    delete segment;
+  }
+}
+
+template<typename T, typename R>
+bool SegmentQueue<T, R>::Pop(T &data) {
+  auto &reclaimer = GetReclaimer();
+  Guard guard(reclaimer);
+  Point hp;
+  for (;;) {
+    auto *head = reclaimer.Protect(head_, hp);
+    // 领取下标之前先判断是否为空, 避免空队列上的出队不断消耗下标
+    if (head->dequeue_.load(std::memory_order_acquire) >= head->enqueue_.load(std::memory_order_acquire) &&
+        head->next_.load(std::memory_order_acquire) == nullptr) {
+      return false;
+    }
+    auto index = head->dequeue_.fetch_add(1, std::memory_order_acq_rel);
+    if (index < SegmentSize) {
+      auto &slot = head->slots_[index];
+      if (slot.state_.exchange(Taken, std::memory_order_acquire) == Ready) {
+        size_.fetch_sub(1, std::memory_order_acq_rel);
+        data = std::move(slot.Get());
+        slot.Get().~T();
+        return true;
+      }
+      continue;
+    }
+    // 当前段已经取完
+    auto *next = head->next_.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    // 退休之前保证 tail_ 不再指向旧段, tail_ 只会向后推进
+    auto *tail = tail_.load(std::memory_order_acquire);
+    if (tail == head) {
+      tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+    }
+    if (head_.compare_exchange_strong(head, next, std::memory_order_acq_rel)) {
+      reclaimer.Retire(head);
+      reclaimer.ReclaimNoHazard();
+    }
+  }
+}
+
+}
+
+#endif
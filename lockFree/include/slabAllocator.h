@@ -0,0 +1,300 @@
+#ifndef SLABALLOCATOR_H_
+#define SLABALLOCATOR_H_
+
+#include <new>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+
+#include "reclaim.h"
+
+namespace lockFree {
+
+/*
+ * 分配器策略只需要提供静态的 Allocate(size) 和 Deallocate(ptr, size),
+ * 容器节点继承 AllocatedBy<A>, new / delete 节点时经过 A, 回收器 delete 节点时同样会回到 A
+ */
+struct NewAllocator {
+  static void* Allocate(size_t size) { return ::operator new(size); }
+
+  static void Deallocate(void *ptr, size_t size) { ::operator delete(ptr, size); }
+};
+
+template<typename A>
+struct AllocatedBy {
+  static void* operator new(size_t size) { return A::Allocate(size); }
+
+  static void operator delete(void *ptr, size_t size) { A::Deallocate(ptr, size); }
+
+  // 超过默认对齐的节点不经过 A
+  static void* operator new(size_t size, std::align_val_t align) { return ::operator new(size, align); }
+
+  static void operator delete(void *ptr, size_t size, std::align_val_t align) { ::operator delete(ptr, size, align); }
+};
+
+/*
+ * 不能继承 AllocatedBy 的类型 (例如哈希表的值) 通过 NewWith 分配, 超过默认对齐的类型同样不经过 A,
+ * DeleteWith 的签名与 DeleteFunction 相同, 可以直接交给回收器
+ */
+template<typename T, typename A, typename ...Args>
+T* NewWith(Args &&...args) {
+  if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return new T(std::forward<Args>(args)...);
+  }
+  void *ptr = A::Allocate(sizeof(T));
+  try {
+    return new (ptr) T(std::forward<Args>(args)...);
+  } catch (...) {
+    A::Deallocate(ptr, sizeof(T));
+    throw;
+  }
+}
+
+template<typename T, typename A>
+void DeleteWith(void *ptr, uintptr_t) {
+  if (ptr == nullptr) {
+    return ;
+  }
+  if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    delete static_cast<T*>(ptr);
+    return ;
+  }
+  static_cast<T*>(ptr)->~T();
+  A::Deallocate(ptr, sizeof(T));
+}
+
+constexpr size_t SlabAlignment = 16;
+
+constexpr size_t SlabMaxBlockSize = 256;
+
+constexpr size_t SlabClassCount = SlabMaxBlockSize / SlabAlignment;
+
+/*
+ * 按 16 字节分级的 slab 分配器, 超过 SlabMaxBlockSize 的请求直接交给全局 operator new
+ * 每个线程每个级别有 loaded_ 和 previous_ 两个弹匣 (magazine), 分配和释放只访问本线程的弹匣;
+ * 两个弹匣都空了才从全局仓库 (depot) 取一整个满弹匣, 都满了才把一整个弹匣放回仓库,
+ * 仓库中没有弹匣时向系统申请一个 slab 切成若干弹匣. 仓库是带版本号的无锁栈
+ * slab 申请后不再归还系统, 释放的块总会回到某个弹匣, 由任意线程再次分配
+ */
+template<size_t MagazineSize = 64, size_t SlabSize = 64 * 1024>
+class SlabAllocator {
+  static_assert(MagazineSize > 0);
+  static_assert(SlabSize / SlabMaxBlockSize >= MagazineSize);
+ public:
+  static void* Allocate(size_t size) {
+    if (size > SlabMaxBlockSize) {
+      return ::operator new(size);
+    }
+    size_t index = ClassOf(size);
+    auto *cache = Local();
+    if (cache == nullptr) [[unlikely]] {
+      return AllocateDetached(index);
+    }
+    auto &loaded = cache->loaded_[index];
+    if (loaded.head_ == nullptr) {
+      Reload(*cache, index);
+    }
+    auto *block = loaded.head_;
+    loaded.head_ = block->next_;
+    loaded.size_--;
+    return block;
+  }
+
+  static void Deallocate(void *ptr, size_t size) {
+    if (size > SlabMaxBlockSize) {
+      ::operator delete(ptr, size);
+      return ;
+    }
+    size_t index = ClassOf(size);
+    auto *block = static_cast<Block*>(ptr);
+    auto *cache = Local();
+    if (cache == nullptr) [[unlikely]] {
+      block->next_ = nullptr;
+      depots_[index].Push(block);
+      return ;
+    }
+    auto &loaded = cache->loaded_[index];
+    if (loaded.size_ >= MagazineSize) {
+      auto &previous = cache->previous_[index];
+      if (previous.head_ != nullptr) {
+        depots_[index].Push(previous.head_);
+      }
+      previous = loaded;
+      loaded = Magazine();
+    }
+    block->next_ = loaded.head_;
+    loaded.head_ = block;
+    loaded.size_++;
+  }
+
+  // 已经向系统申请的 slab 字节数
+  static size_t SlabBytes() { return slab_bytes_.load(std::memory_order_relaxed); }
+
+  SlabAllocator() = delete;
+
+ private:
+  // 块空闲时开头两个字保存弹匣内和仓库中的链接, 所以最小的块为 16 字节
+  struct Block {
+    Block *next_;
+    Block *next_magazine_;
+  };
+
+  // size_ 不小于链表的实际长度, 从仓库取出的弹匣一律按满弹匣计数
+  struct Magazine {
+    Block *head_{nullptr};
+    size_t size_{0};
+  };
+
+  /*
+   * 高 16 位为版本号, 低 48 位为弹匣头块的地址
+   * 出栈时读到的 next_magazine_ 可能已经被其他线程取走并改写, 这时版本号一定变化, CAS 失败后重试;
+   * slab 不归还系统, 读取本身不会访问非法内存
+   */
+  class Depot {
+   public:
+    constexpr Depot() : head_(0) {}
+
+    void Push(Block *magazine) {
+      assert((reinterpret_cast<uint64_t>(magazine) & ~AddressMask) == 0);
+      auto head = head_.load(std::memory_order_relaxed);
+      do {
+        magazine->next_magazine_ = Address(head);
+      } while (!head_.compare_exchange_weak(head, Pack(magazine, head), std::memory_order_release,
+                                            std::memory_order_relaxed));
+    }
+
+    Block* Pop() {
+      auto head = head_.load(std::memory_order_acquire);
+      while (Address(head) != nullptr) {
+        auto *next = Address(head)->next_magazine_;
+        if (head_.compare_exchange_weak(head, Pack(next, head), std::memory_order_acquire,
+                                        std::memory_order_acquire)) {
+          return Address(head);
+        }
+      }
+      return nullptr;
+    }
+
+   private:
+    static constexpr int TagShift = 48;
+
+    static constexpr uint64_t AddressMask = (uint64_t(1) << TagShift) - 1;
+
+    static Block* Address(uint64_t head) { return reinterpret_cast<Block*>(head & AddressMask); }
+
+    // Pop 读到的 next 可能已经被改写成任意值, 只有 CAS 成功时才是有效地址, 这里不能断言
+    static uint64_t Pack(Block *block, uint64_t old) {
+      auto address = reinterpret_cast<uint64_t>(block) & AddressMask;
+      return (((old >> TagShift) + 1) << TagShift) | address;
+    }
+
+    alignas(CacheLineSize) std::atomic<uint64_t> head_;
+  };
+
+  enum CacheState : uint8_t { Fresh, Active, Detached };
+
+  // 平凡析构, 线程退出时由 CacheFlusher 归还弹匣, 之后的分配和释放直接访问仓库
+  struct Cache {
+    Magazine loaded_[SlabClassCount];
+    Magazine previous_[SlabClassCount];
+    CacheState state_{Fresh};
+  };
+
+  struct CacheFlusher {
+    CacheFlusher() = default;
+
+    ~ CacheFlusher() {
+      auto &cache = LocalCache();
+      for (size_t index = 0; index < SlabClassCount; index++) {
+        for (auto *magazine : {&cache.loaded_[index], &cache.previous_[index]}) {
+          if (magazine->head_ != nullptr) {
+            depots_[index].Push(magazine->head_);
+          }
+          *magazine = Magazine();
+        }
+      }
+      cache.state_ = Detached;
+    }
+
+    CacheFlusher(const CacheFlusher &other) = delete;
+    CacheFlusher(CacheFlusher &&other) = delete;
+    CacheFlusher& operator = (const CacheFlusher &other) = delete;
+    CacheFlusher& operator = (CacheFlusher &&other) = delete;
+  };
+
+  static size_t ClassOf(size_t size) { return size == 0 ? 0 : (size - 1) / SlabAlignment; }
+
+  static Cache& LocalCache() {
+    thread_local Cache cache;
+    return cache;
+  }
+
+  // 其他 thread_local 对象 (例如回收器) 析构时仍可能释放节点, 所以缓存本身不析构, 只是转为 Detached
+  static Cache* Local() {
+    auto &cache = LocalCache();
+    if (cache.state_ == Active) [[likely]] {
+      return &cache;
+    }
+    if (cache.state_ == Detached) {
+      return nullptr;
+    }
+    thread_local CacheFlusher flusher;
+    cache.state_ = Active;
+    return &cache;
+  }
+
+  static void Reload(Cache &cache, size_t index) {
+    auto &loaded = cache.loaded_[index];
+    auto &previous = cache.previous_[index];
+    if (previous.head_ != nullptr) {
+      std::swap(loaded, previous);
+      return ;
+    }
+    auto *magazine = depots_[index].Pop();
+    loaded.head_ = magazine != nullptr ? magazine : NewSlab(index);
+    loaded.size_ = MagazineSize;
+  }
+
+  static void* AllocateDetached(size_t index) {
+    auto *magazine = depots_[index].Pop();
+    if (magazine == nullptr) {
+      magazine = NewSlab(index);
+    }
+    if (magazine->next_ != nullptr) {
+      depots_[index].Push(magazine->next_);
+    }
+    return magazine;
+  }
+
+  // 切分新的 slab, 第一个弹匣返回给调用者, 其余放入仓库
+  static Block* NewSlab(size_t index) {
+    size_t block_size = (index + 1) * SlabAlignment;
+    size_t count = SlabSize / block_size;
+    auto *slab = static_cast<char*>(::operator new(SlabSize, std::align_val_t(CacheLineSize)));
+    slab_bytes_.fetch_add(SlabSize, std::memory_order_relaxed);
+
+    Block *first = nullptr;
+    for (size_t begin = 0; begin < count; begin += MagazineSize) {
+      Block *head = nullptr;
+      for (size_t i = std::min(count, begin + MagazineSize); i > begin; i--) {
+        auto *block = reinterpret_cast<Block*>(slab + (i - 1) * block_size);
+        block->next_ = head;
+        head = block;
+      }
+      if (first == nullptr) {
+        first = head;
+      } else {
+        depots_[index].Push(head);
+      }
+    }
+    return first;
+  }
+
+  inline static Depot depots_[SlabClassCount];
+  inline static std::atomic<size_t> slab_bytes_{0};
+};
+
+}
+
+#endif
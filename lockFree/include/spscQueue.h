@@ -0,0 +1,168 @@
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "reclaim.h"
+
+namespace lockFree {
+
+/*
+ * 单生产者单消费者的有界环形队列, 容量向上取整为 2 的幂
+ * head_ 只由消费者写, tail_ 只由生产者写, 两边都只需要 acquire / release 的读写, 入队和出队都是 wait-free 的
+ * 每一边在自己的缓存行中缓存对方的下标, 只有缓存的下标显示队列满 (空) 时才重新读取对方的下标,
+ * 避免每次操作都让对方的缓存行在两个核之间来回传递
+ * PushBulk / PopBulk 一次预留多个槽, 整批只发布一次下标
+ */
+template<typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : mask_(RoundUp(capacity) - 1), slots_(new Slot[mask_ + 1]), head_(0), cached_tail_(0), tail_(0),
+        cached_head_(0) {}
+
+  ~ SpscQueue() {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+      slots_[head & mask_].Get().~T();
+    }
+  }
+
+  // 只能由生产者线程调用, 队列满时返回 false
+  bool TryPush(const T &data) { return TryEmplace(data); }
+
+  bool TryPush(T &&data) { return TryEmplace(std::move(data)); }
+
+  template<typename ...Args>
+  bool TryEmplace(Args &&...args);
+
+  // 尽可能多地写入 [first, last) 中的元素, 返回写入的个数
+  template<typename InputIt>
+  size_t PushBulk(InputIt first, InputIt last);
+
+  // 只能由消费者线程调用, 队列空时返回 false
+  bool TryPop(T &data);
+
+  // 最多取出 max 个元素依次写入 out, 返回取出的个数
+  template<typename OutputIt>
+  size_t PopBulk(OutputIt out, size_t max);
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  size_t Size() {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  SpscQueue(const SpscQueue &other) = delete;
+  SpscQueue(SpscQueue &&other) = delete;
+  SpscQueue& operator = (const SpscQueue &other) = delete;
+  SpscQueue& operator = (SpscQueue &&other) = delete;
+
+ private:
+  struct Slot {
+    T& Get() { return *std::launder(reinterpret_cast<T*>(storage_)); }
+
+    alignas(T) unsigned char storage_[sizeof(T)];
+  };
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  // 生产者可以写入的槽数, 缓存不够 need 时才读取 head_
+  size_t Free(size_t tail, size_t need) {
+    auto free = Capacity() - (tail - cached_head_);
+    if (free < need) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      free = Capacity() - (tail - cached_head_);
+    }
+    return free;
+  }
+
+  // 消费者可以读取的元素个数, 缓存不够 need 时才读取 tail_
+  size_t Available(size_t head, size_t need) {
+    auto available = cached_tail_ - head;
+    if (available < need) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      available = cached_tail_ - head;
+    }
+    return available;
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  // 消费者的缓存行
+  alignas(CacheLineSize) std::atomic<size_t> head_;
+  size_t cached_tail_;
+  // 生产者的缓存行
+  alignas(CacheLineSize) std::atomic<size_t> tail_;
+  size_t cached_head_;
+};
+
+template<typename T> template<typename ...Args>
+bool SpscQueue<T>::TryEmplace(Args &&...args) {
+  auto tail = tail_.load(std::memory_order_relaxed);
+  if (Free(tail, 1) == 0) {
+    return false;
+  }
+  new (slots_[tail & mask_].storage_) T(std::forward<Args>(args)...);
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T> template<typename InputIt>
+size_t SpscQueue<T>::PushBulk(InputIt first, InputIt last) {
+  auto tail = tail_.load(std::memory_order_relaxed);
+  auto free = Free(tail, Capacity());
+  size_t count = 0;
+  for (; first != last && count < free; ++first, ++count) {
+    new (slots_[(tail + count) & mask_].storage_) T(*first);
+  }
+  if (count != 0) {
+    tail_.store(tail + count, std::memory_order_release);
+  }
+  return count;
+}
+
+template<typename T>
+bool SpscQueue<T>::TryPop(T &data) {
+  auto head = head_.load(std::memory_order_relaxed);
+  if (Available(head, 1) == 0) {
+    return false;
+  }
+  auto &slot = slots_[head & mask_];
+  data = std::move(slot.Get());
+  slot.Get().~T();
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T> template<typename OutputIt>
+size_t SpscQueue<T>::PopBulk(OutputIt out, size_t max) {
+  auto head = head_.load(std::memory_order_relaxed);
+  auto count = std::min(max, Available(head, max));
+  for (size_t i = 0; i < count; i++) {
+    auto &slot = slots_[(head + i) & mask_];
+    *out++ = std::move(slot.Get());
+    slot.Get().~T();
+  }
+  if (count != 0) {
+    head_.store(head + count, std::memory_order_release);
+  }
+  return count;
+}
+
+}
+
+#endif
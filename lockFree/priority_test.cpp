@@ -0,0 +1,212 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cassert>
+
+#include "reclaim.h"
+#include "lockFreePriorityQueue.h"
+#include "block.h"
+
+void basic_test() {
+  lockFree::LockFreePriorityQueue<int, std::string> q;
+  std::vector<int> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(i % 100);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  for (int i = 0; i < 1000; i++) {
+    std::string str = "lifehappy" + std::to_string(keys[i]);
+    if (i & 1) {
+      q.Push(keys[i], str);
+      assert(str == "lifehappy" + std::to_string(keys[i]));
+    } else {
+      q.Push(keys[i], std::move(str));
+    }
+    assert(q.Size() == i + 1);
+  }
+  int last = -1;
+  int key;
+  std::string str;
+  for (int i = 0; i < 1000; i++) {
+    assert(q.Pop(key, str));
+    assert(last <= key);
+    assert(str == "lifehappy" + std::to_string(key));
+    last = key;
+  }
+  assert(!q.Pop(key, str));
+  assert(q.Size() == 0);
+  std::cout << lockFree::LockFreePriorityQueue<int, std::string>::Global_Size() << "\n";
+}
+
+// 每个元素恰好出队一次, 单线程的 PopRelaxed 出队的元素不会超出最小的 relaxation 个
+void relaxed_test() {
+  lockFree::LockFreePriorityQueue<int, int> q(4);
+  for (int i = 0; i < 1000; i++) {
+    q.Push(i, i);
+  }
+  std::vector<bool> seen(1000, false);
+  int key;
+  int value;
+  for (int i = 0; i < 1000; i++) {
+    assert(q.PopRelaxed(key, value));
+    assert(key == value && !seen[key]);
+    assert(std::count(seen.begin(), seen.begin() + key, false) < 4);
+    seen[key] = true;
+  }
+  assert(!q.PopRelaxed(key, value));
+}
+
+template<typename R, bool Relaxed>
+void concurrent_test(size_t producer, size_t consumer, int limit) {
+  lockFree::LockFreePriorityQueue<int, int, R> q;
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+  std::vector<std::atomic<int>> seen(limit * producer);
+
+  for (size_t i = 0; i < producer; i++) {
+    producers.emplace_back([&q, i, limit]() {
+      for (int j = 0; j < limit; j++) {
+        auto value = static_cast<int>(i) * limit + j;
+        q.Push(value % 997, value);
+      }
+    });
+  }
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+  for (size_t i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, &seen, need]() {
+      int key;
+      int value;
+      for (int j = 0; j < need; j++) {
+        while (!(Relaxed ? q.PopRelaxed(key, value) : q.Pop(key, value)));
+        assert(key == value % 997);
+        seen[value].fetch_add(1);
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+  for (auto &it : seen) {
+    assert(it.load() == 1);
+  }
+  assert(q.Size() == 0);
+}
+
+template<typename R, bool Relaxed>
+void lock_free_priority_queue(size_t producer, size_t consumer, int limit) {
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  lockFree::LockFreePriorityQueue<int, std::string, R> q;
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, i, limit]() {
+      std::mt19937 rng(i);
+      std::string str = "lifehappy";
+      for (int i = 0; i < limit; i++) {
+        q.Push(static_cast<int>(rng() % 1000000), str);
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, limit = need]() {
+      int key;
+      std::string value;
+      for (int i = 0; i < limit; i++) {
+        while (!(Relaxed ? q.PopRelaxed(key, value) : q.Pop(key, value)));
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+}
+
+void block_priority_queue(size_t producer, size_t consumer, int limit) {
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  block::BlockPriorityQueue<int, std::string> q;
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, i, limit]() {
+      std::mt19937 rng(i);
+      std::string str = "lifehappy";
+      for (int i = 0; i < limit; i++) {
+        q.Push(static_cast<int>(rng() % 1000000), str);
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, limit = need]() {
+      int key;
+      std::string value;
+      for (int i = 0; i < limit; i++) {
+        while (!q.Pop(key, value));
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+}
+
+void benchmark_test() {
+  for (int i : {1, 2, 4, 8}) {
+    for (int j : {1, 2, 4, 8}) {
+      auto begin_lock_free = std::chrono::steady_clock::now();
+      lock_free_priority_queue<lockFree::Reclaimer, false>(i, j, 200000);
+      auto end_lock_free = std::chrono::steady_clock::now();
+
+      auto begin_relaxed = std::chrono::steady_clock::now();
+      lock_free_priority_queue<lockFree::Reclaimer, true>(i, j, 200000);
+      auto end_relaxed = std::chrono::steady_clock::now();
+
+      auto begin_epoch_relaxed = std::chrono::steady_clock::now();
+      lock_free_priority_queue<lockFree::EpochReclaimer, true>(i, j, 200000);
+      auto end_epoch_relaxed = std::chrono::steady_clock::now();
+
+      auto begin_block = std::chrono::steady_clock::now();
+      block_priority_queue(i, j, 200000);
+      auto end_block = std::chrono::steady_clock::now();
+
+      printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms), Relaxed(%5lld ms), EpochRelaxed(%5lld ms), Block(%5lld ms)\n", i, j,
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_relaxed - begin_relaxed).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch_relaxed - begin_epoch_relaxed).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
+    }
+  }
+}
+
+int main() {
+  basic_test();
+  relaxed_test();
+  concurrent_test<lockFree::Reclaimer, false>(4, 4, 20000);
+  concurrent_test<lockFree::Reclaimer, true>(4, 4, 20000);
+  concurrent_test<lockFree::EpochReclaimer, true>(4, 4, 20000);
+  concurrent_test<lockFree::EraReclaimer, true>(4, 4, 20000);
+
+//  benchmark_test();
+  return 0;
+}
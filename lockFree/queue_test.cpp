@@ -4,6 +4,11 @@
 
 #include "reclaim.h"
 #include "lockFreeQueue.h"
+#include "boundedQueue.h"
+#include "spscQueue.h"
+#include "segmentQueue.h"
+#include "mpscQueue.h"
+#include "multiQueue.h"
 #include "block.h"
 
 void basic_test() {
@@ -163,11 +168,322 @@ void ten_to_ten() {
   std::cout << lockFree::LockFreeQueue<std::string>::Global_Size() << "\n";
 }
 
-void lock_free_queue(size_t producer, size_t consumer, int limit) {
+void own_domain_test() {
+  auto domain = std::make_shared<lockFree::HazardDomain>();
+  lockFree::LockFreeQueue<std::string> shared_a(domain);
+  lockFree::LockFreeQueue<std::string> shared_b(domain);
+  lockFree::LockFreeQueue<std::string> own(std::make_shared<lockFree::HazardDomain>());
+  assert(shared_a.GetDomain() == shared_b.GetDomain());
+  assert(own.GetDomain() != domain);
+
+  std::vector<std::thread> threads;
+  for (auto *q : {&shared_a, &shared_b, &own}) {
+    threads.emplace_back([q]() {
+      for (int i = 0; i < 1000; i++) {
+        q->Push("lifehappy" + std::to_string(i));
+      }
+    });
+    threads.emplace_back([q]() {
+      std::string str;
+      for (int i = 0; i < 1000; i++) {
+        while (!q->Pop(str));
+        assert(str == "lifehappy" + std::to_string(i));
+      }
+    });
+  }
+  for (auto &it : threads) {
+    it.join();
+  }
+
+  std::cout << domain->Size() << " " << own.GetDomain()->Size() << " "
+            << lockFree::LockFreeQueue<std::string>::Global_Size() << "\n";
+}
+
+// 统计存活对象数量, 用于估算尚未回收的节点
+struct Tracked {
+  Tracked() { live_.fetch_add(1, std::memory_order_relaxed); }
+  Tracked(const Tracked &other) : value_(other.value_) { live_.fetch_add(1, std::memory_order_relaxed); }
+  ~ Tracked() { live_.fetch_sub(1, std::memory_order_relaxed); }
+
+  Tracked& operator = (const Tracked &other) = default;
+
+  static std::atomic<int64_t> live_;
+  int64_t value_{0};
+};
+
+std::atomic<int64_t> Tracked::live_{0};
+
+/*
+ * 一个常驻的消费者线程持续 Pop, 同时不断创建短生命周期的线程 Push / Pop 后退出,
+ * 统计线程从完成工作到 join 返回的退出延迟, 以及尚未回收的节点峰值
+ */
+void short_lived_threads_test(int rounds, int threads_per_round, int limit) {
+  lockFree::LockFreeQueue<Tracked> q;
+  std::atomic<bool> stop{false};
+  std::atomic<int64_t> peak{0};
+
+  auto monitor = std::thread([&q, &stop, &peak]() {
+    while (!stop.load(std::memory_order_acquire)) {
+      auto retained = Tracked::live_.load(std::memory_order_relaxed) - static_cast<int64_t>(q.Size());
+      auto old_peak = peak.load(std::memory_order_relaxed);
+      while (retained > old_peak && !peak.compare_exchange_weak(old_peak, retained));
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+  auto consumer = std::thread([&q, &stop]() {
+    Tracked value;
+    while (!stop.load(std::memory_order_acquire)) {
+      q.Pop(value);
+    }
+  });
+
+  int64_t total_latency = 0;
+  int64_t max_latency = 0;
+  for (int round = 0; round < rounds; round++) {
+    std::vector<std::thread> threads;
+    std::vector<std::chrono::steady_clock::time_point> finish(threads_per_round);
+    for (int i = 0; i < threads_per_round; i++) {
+      threads.emplace_back([&q, &finish, limit](int id) {
+        Tracked value;
+        for (int j = 0; j < limit; j++) {
+          q.Push(value);
+          q.Pop(value);
+        }
+        finish[id] = std::chrono::steady_clock::now();
+      }, i);
+    }
+    for (int i = 0; i < threads_per_round; i++) {
+      threads[i].join();
+      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - finish[i]).count();
+      total_latency += latency;
+      max_latency = std::max(max_latency, static_cast<int64_t>(latency));
+    }
+  }
+
+  stop.store(true, std::memory_order_release);
+  monitor.join();
+  consumer.join();
+
+  printf("Threads(%5d), Exit latency avg(%6lld us) max(%6lld us), Peak retained(%7lld), Orphans(%5lu)\n",
+         rounds * threads_per_round, static_cast<int64_t>(total_latency / (rounds * threads_per_round)),
+         static_cast<int64_t>(max_latency), static_cast<int64_t>(peak.load()), q.GetDomain()->OrphanSize());
+}
+
+// 统计 backpressure 回调的调用次数
+void CountPressure(uintptr_t context, size_t nodes, size_t bytes, uint32_t attempt) {
+  reinterpret_cast<std::atomic<int64_t>*>(context)->fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * 后台回收线程很少被唤醒, 模拟回收跟不上退休速度的情况, 比较有无上限时尚未回收的节点峰值
+ */
+void bounded_memory_test(size_t max_nodes, size_t producer, size_t consumer, int limit) {
+  std::atomic<int64_t> pressure{0};
+  lockFree::ReclaimServiceOptions options;
+  options.wake_threshold_ = SIZE_MAX;
+  options.interval_ = std::chrono::milliseconds(200);
+  lockFree::ReclaimLimit reclaim_limit;
+  reclaim_limit.max_nodes_ = max_nodes;
+  reclaim_limit.callback_ = CountPressure;
+  reclaim_limit.callback_context_ = reinterpret_cast<uintptr_t>(&pressure);
+  auto domain = std::make_shared<lockFree::HazardDomain>(lockFree::HazardFence::Symmetric, options, reclaim_limit);
+
+  int64_t base = Tracked::live_.load(std::memory_order_relaxed);
+  int64_t peak = 0;
+  auto begin = std::chrono::steady_clock::now();
+  {
+    lockFree::LockFreeQueue<Tracked> q(domain);
+    std::atomic<bool> stop{false};
+    auto monitor = std::thread([&q, &stop, &peak, base]() {
+      while (!stop.load(std::memory_order_acquire)) {
+        peak = std::max(peak, Tracked::live_.load(std::memory_order_relaxed) - base - static_cast<int64_t>(q.Size()));
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < producer; i++) {
+      threads.emplace_back([&q, limit]() {
+        Tracked value;
+        for (int i = 0; i < limit; i++) {
+          q.Push(value);
+        }
+      });
+    }
+    int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+    for (size_t i = 0; i < consumer; i++) {
+      threads.emplace_back([&q, need]() {
+        Tracked value;
+        for (int i = 0; i < need; i++) {
+          while (!q.Pop(value));
+        }
+      });
+    }
+    for (auto &it : threads) {
+      it.join();
+    }
+    stop.store(true, std::memory_order_release);
+    monitor.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  printf("Limit(%7lu), Producer(%2lu), Consumer(%2lu), Peak retained(%8lld), Pressure callbacks(%6lld), %5lld ms\n",
+         max_nodes, producer, consumer, static_cast<int64_t>(peak), static_cast<int64_t>(pressure.load()),
+         static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()));
+}
+
+/*
+ * 一个读线程进入临界区并保护一个节点之后停住, 模拟很长的遍历,
+ * 其他线程持续 Push / Pop, 比较不同回收策略下尚未回收的节点峰值
+ */
+template<typename R>
+void stalled_reader_test(const char *name, size_t threads, int limit) {
+  lockFree::LockFreeQueue<Tracked, R> q(std::make_shared<typename R::Domain>());
+  std::atomic<bool> stop{false};
+  std::atomic<bool> stalled{false};
+  int64_t base = Tracked::live_.load(std::memory_order_relaxed);
+  int64_t peak = 0;
+
+  auto reader = std::thread([&q, &stop, &stalled]() {
+    auto &reclaimer = lockFree::ReclaimerRegistry<R>::GetInstance(q.GetDomain());
+    Tracked value;
+    std::atomic<Tracked*> anchor{&value};
+    typename R::Guard guard(reclaimer);
+    typename R::Point point;
+    reclaimer.Protect(anchor, point);
+    stalled.store(true, std::memory_order_release);
+    while (!stop.load(std::memory_order_acquire)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  while (!stalled.load(std::memory_order_acquire));
+
+  auto monitor = std::thread([&q, &stop, &peak, base]() {
+    while (!stop.load(std::memory_order_acquire)) {
+      peak = std::max(peak, Tracked::live_.load(std::memory_order_relaxed) - base - static_cast<int64_t>(q.Size()));
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back([&q, limit]() {
+      Tracked value;
+      for (int i = 0; i < limit; i++) {
+        q.Push(value);
+        q.Pop(value);
+      }
+    });
+  }
+  for (auto &it : workers) {
+    it.join();
+  }
+  stop.store(true, std::memory_order_release);
+  monitor.join();
+  reader.join();
+
+  printf("%6s, Threads(%2lu), Peak retained(%8lld)\n", name, threads, static_cast<int64_t>(peak));
+}
+
+void segment_queue(size_t producer, size_t consumer, int limit) {
   std::vector<std::thread> producers;
   std::vector<std::thread> consumers;
 
-  lockFree::LockFreeQueue<std::string> q;
+  lockFree::SegmentQueue<std::string> q;
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, limit]() {
+      std::string str = "lifehappy";
+      for (int i = 0; i < limit; i++) {
+        if (i & 1) {
+          q.Push(str);
+        } else {
+          q.Push(std::move(str));
+        }
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, limit = need]() {
+      std::string value;
+      for (int i = 0; i < limit; i++) {
+        while (!q.Pop(value));
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+}
+
+// 多个生产者一个消费者, 每个生产者的元素按入队顺序出队
+void mpsc_test() {
+  lockFree::MpscQueue<std::pair<int, int>> q;
+  std::vector<std::thread> producers;
+  for (int i = 0; i < 5; i++) {
+    producers.emplace_back([&q, i]() {
+      for (int j = 0; j < 100000; j++) {
+        q.Push({i, j});
+      }
+    });
+  }
+  std::vector<int> next(5, 0);
+  std::pair<int, int> value;
+  for (int i = 0; i < 500000; i++) {
+    while (!q.Pop(value));
+    assert(value.second == next[value.first]);
+    next[value.first]++;
+  }
+  for (auto &it : producers) {
+    it.join();
+  }
+  assert(q.Empty());
+}
+
+void mpsc_queue(size_t producer, int limit) {
+  std::vector<std::thread> producers;
+
+  lockFree::MpscQueue<std::string> q;
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, limit]() {
+      std::string str = "lifehappy";
+      for (int i = 0; i < limit; i++) {
+        if (i & 1) {
+          q.Push(str);
+        } else {
+          q.Push(std::move(str));
+        }
+      }
+    });
+  }
+
+  std::thread consumer([&q, limit = limit * static_cast<int>(producer)]() {
+    std::string value;
+    for (int i = 0; i < limit; i++) {
+      while (!q.Pop(value));
+    }
+  });
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  consumer.join();
+}
+
+void multi_queue(size_t producer, size_t consumer, int limit, size_t factor, size_t stickiness) {
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  lockFree::MultiQueue<std::string> q(producer + consumer, factor, stickiness);
 
   for (auto i = 0; i < producer; i++) {
     producers.emplace_back([&q, limit]() {
@@ -201,6 +517,180 @@ void lock_free_queue(size_t producer, size_t consumer, int limit) {
   }
 }
 
+/*
+ * 按顺序放入 0 ~ limit - 1 再全部取出, 每次出队的 rank error 为此时还在队列中且比它更早入队的元素个数, 严格 FIFO 时为 0
+ * 分片数按 threads 个线程计算, 由一个线程放入和取出, 只反映分片和粘性带来的偏离, 不包含线程调度造成的误差
+ */
+void rank_error(size_t threads, int limit, size_t factor, size_t stickiness, double &mean, int64_t &max) {
+  lockFree::MultiQueue<int> q(threads, factor, stickiness);
+  for (int i = 0; i < limit; i++) {
+    q.Push(i);
+  }
+  std::vector<int> order(limit);
+  for (int i = 0; i < limit; i++) {
+    while (!q.Pop(order[i]));
+  }
+  // 树状数组记录仍在队列中的元素
+  std::vector<int64_t> tree(limit + 1, 0);
+  auto add = [&tree, limit](int index, int64_t delta) {
+    for (index++; index <= limit; index += index & -index) {
+      tree[index] += delta;
+    }
+  };
+  auto prefix = [&tree](int index) {
+    int64_t sum = 0;
+    for (; index > 0; index -= index & -index) {
+      sum += tree[index];
+    }
+    return sum;
+  };
+  for (int i = 0; i < limit; i++) {
+    add(i, 1);
+  }
+  int64_t sum = 0;
+  max = 0;
+  for (int i = 0; i < limit; i++) {
+    auto error = prefix(order[i]);
+    sum += error;
+    max = std::max(max, error);
+    add(order[i], -1);
+  }
+  mean = static_cast<double>(sum) / limit;
+}
+
+template<typename R>
+void lock_free_queue(size_t producer, size_t consumer, int limit, size_t batch = 1) {
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  lockFree::LockFreeQueue<std::string, R> q;
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, limit, batch]() {
+      std::string str = "lifehappy";
+      if (batch > 1) {
+        std::vector<std::string> items(batch, str);
+        for (int i = 0; i < limit; i += static_cast<int>(batch)) {
+          auto size = std::min<size_t>(batch, limit - i);
+          q.PushBulk(items.begin(), items.begin() + static_cast<int64_t>(size));
+        }
+        return ;
+      }
+      for (int i = 0; i < limit; i++) {
+        if (i & 1) {
+          q.Push(str);
+        } else {
+          q.Push(std::move(str));
+        }
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, limit = need, batch]() {
+      if (batch > 1) {
+        std::vector<std::string> values(batch);
+        for (int i = 0; i < limit; ) {
+          i += static_cast<int>(q.PopBulk(values.begin(), std::min<size_t>(batch, limit - i)));
+        }
+        return ;
+      }
+      std::string value;
+      for (int i = 0; i < limit; i++) {
+        while (!q.Pop(value));
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+}
+
+// 队列满或空时让出 CPU 后重试, 容量远小于元素总数, 入队和出队线程会交替等待
+void bounded_queue(size_t producer, size_t consumer, int limit) {
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  lockFree::BoundedQueue<std::string> q(4096);
+
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, limit]() {
+      std::string str = "lifehappy";
+      for (int i = 0; i < limit; i++) {
+        while (!q.TryPush(str)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, limit = need]() {
+      std::string value;
+      for (int i = 0; i < limit; i++) {
+        while (!q.TryPop(value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+}
+
+// batch 大于 1 时使用 PushBulk / PopBulk, 队列满或空时让出 CPU 后重试
+void spsc_queue(int limit, size_t batch) {
+  lockFree::SpscQueue<std::string> q(4096);
+
+  std::thread producer([&q, limit, batch]() {
+    std::string str = "lifehappy";
+    if (batch > 1) {
+      std::vector<std::string> items(batch, str);
+      for (int i = 0; i < limit; ) {
+        auto size = std::min<size_t>(batch, limit - i);
+        auto count = q.PushBulk(items.begin(), items.begin() + static_cast<int64_t>(size));
+        if (count == 0) {
+          std::this_thread::yield();
+        }
+        i += static_cast<int>(count);
+      }
+      return ;
+    }
+    for (int i = 0; i < limit; i++) {
+      while (!q.TryPush(str)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::thread consumer([&q, limit, batch]() {
+    std::vector<std::string> values(batch);
+    for (int i = 0; i < limit; ) {
+      auto count = batch > 1 ? q.PopBulk(values.begin(), batch) : q.TryPop(values[0]);
+      if (count == 0) {
+        std::this_thread::yield();
+      }
+      i += static_cast<int>(count);
+    }
+  });
+
+  producer.join();
+  consumer.join();
+}
+
 void block_queue(size_t producer, size_t consumer, int limit) {
   std::vector<std::thread> producers;
   std::vector<std::thread> consumers;
@@ -238,36 +728,299 @@ void block_queue(size_t producer, size_t consumer, int limit) {
   }
 }
 
+/*
+ * 统计每次成功 Pop 的耗时分布, domain 为 nullptr 时使用默认 domain 在 Pop 中同步扫描,
+ * 否则使用传入的 domain, 例如启用了后台回收线程的 domain
+ */
+void pop_latency_test(const char *name, std::shared_ptr<lockFree::HazardDomain> domain,
+                      size_t producer, size_t consumer, int limit) {
+  lockFree::LockFreeQueue<std::string> q(domain ? domain : lockFree::LockFreeQueue<std::string>::DefaultDomain());
+
+  std::vector<std::thread> producers;
+  for (auto i = 0; i < producer; i++) {
+    producers.emplace_back([&q, limit]() {
+      for (int i = 0; i < limit; i++) {
+        q.Push("lifehappy");
+      }
+    });
+  }
+
+  int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
+  std::vector<std::vector<int64_t>> latencies(consumer);
+  std::vector<std::thread> consumers;
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, &latencies, limit = need](size_t id) {
+      std::string value;
+      auto &latency = latencies[id];
+      latency.reserve(limit);
+      for (int i = 0; i < limit; i++) {
+        while (true) {
+          auto begin = std::chrono::steady_clock::now();
+          bool ok = q.Pop(value);
+          auto end = std::chrono::steady_clock::now();
+          if (ok) {
+            latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+            break;
+          }
+        }
+      }
+    }, i);
+  }
+
+  for (auto &it : producers) {
+    it.join();
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+
+  std::vector<int64_t> all;
+  for (auto &it : latencies) {
+    all.insert(all.end(), it.begin(), it.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) {
+    return static_cast<int64_t>(all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]);
+  };
+  printf("%10s, Producer(%2lu), Consumer(%2lu), p50(%6lld ns), p99(%6lld ns), p999(%7lld ns), max(%9lld ns)\n",
+         name, producer, consumer, percentile(0.5), percentile(0.99), percentile(0.999), all.back());
+}
+
+void latency_test() {
+  for (size_t i : {1, 4, 10}) {
+    for (size_t j : {1, 4, 10}) {
+      pop_latency_test("Inline", nullptr, i, j, 200000);
+      lockFree::ReclaimServiceOptions options;
+      pop_latency_test("Background", std::make_shared<lockFree::HazardDomain>(lockFree::HazardFence::Symmetric, options),
+                       i, j, 200000);
+    }
+  }
+}
+
+/*
+ * 生产者每隔 interval 入队一个时间戳, 消费者用自旋的 Pop 或者 PopWait 等待,
+ * 统计消费者线程占用的 CPU 时间以及从入队到出队的唤醒延迟; 时间戳为默认值时消费者退出
+ */
+template<bool Wait>
+void wait_latency_test(const char *name, size_t consumer, int limit, std::chrono::microseconds interval) {
+  using TimePoint = std::chrono::steady_clock::time_point;
+  lockFree::LockFreeQueue<TimePoint> q;
+
+  std::vector<std::vector<int64_t>> latencies(consumer);
+  std::atomic<int64_t> cpu_ns{0};
+  std::vector<std::thread> consumers;
+  for (auto i = 0; i < consumer; i++) {
+    consumers.emplace_back([&q, &latencies, &cpu_ns](size_t id) {
+      TimePoint value;
+      for (;;) {
+        if constexpr (Wait) {
+          q.PopWait(value);
+        } else {
+          while (!q.Pop(value));
+        }
+        if (value == TimePoint()) {
+          break;
+        }
+        latencies[id].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - value).count());
+      }
+      timespec ts{};
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      cpu_ns.fetch_add(ts.tv_sec * 1000000000LL + ts.tv_nsec, std::memory_order_relaxed);
+    }, i);
+  }
+
+  for (int i = 0; i < limit; i++) {
+    std::this_thread::sleep_for(interval);
+    q.Push(std::chrono::steady_clock::now());
+  }
+  for (auto i = 0; i < consumer; i++) {
+    q.Push(TimePoint());
+  }
+  for (auto &it : consumers) {
+    it.join();
+  }
+
+  std::vector<int64_t> all;
+  for (auto &it : latencies) {
+    all.insert(all.end(), it.begin(), it.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) {
+    return static_cast<int64_t>(all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]);
+  };
+  printf("%5s, Consumer(%2lu), CPU(%6lld ms), p50(%8lld ns), p99(%9lld ns), max(%9lld ns)\n", name, consumer,
+         static_cast<int64_t>(cpu_ns.load() / 1000000), percentile(0.5), percentile(0.99), all.back());
+}
+
+void wait_test() {
+  for (size_t consumer : {1, 4}) {
+    wait_latency_test<false>("Spin", consumer, 1000, std::chrono::microseconds(1000));
+    wait_latency_test<true>("Wait", consumer, 1000, std::chrono::microseconds(1000));
+  }
+}
+
 void benchmark_test() {
   for (int i = 1; i <= 10; i++) {
     for (int j = 1; j <= 10; j++) {
       auto begin_lock_free = std::chrono::steady_clock::now();
-      lock_free_queue(i, j, 1000000);
+      lock_free_queue<lockFree::Reclaimer>(i, j, 1000000);
       auto end_lock_free = std::chrono::steady_clock::now();
 
+      auto begin_epoch = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::EpochReclaimer>(i, j, 1000000);
+      auto end_epoch = std::chrono::steady_clock::now();
+
+      auto begin_era = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::EraReclaimer>(i, j, 1000000);
+      auto end_era = std::chrono::steady_clock::now();
+
+      auto begin_segment = std::chrono::steady_clock::now();
+      segment_queue(i, j, 1000000);
+      auto end_segment = std::chrono::steady_clock::now();
+
+      auto begin_bounded = std::chrono::steady_clock::now();
+      bounded_queue(i, j, 1000000);
+      auto end_bounded = std::chrono::steady_clock::now();
 
       auto begin_block = std::chrono::steady_clock::now();
       block_queue(i, j, 1000000);
       auto end_block = std::chrono::steady_clock::now();
 
-      printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms), Block(%5lld ms)\n", i, j,
+      printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms), Epoch(%5lld ms), Era(%5lld ms), Segment(%5lld ms), Bounded(%5lld ms), Block(%5lld ms)\n", i, j,
              static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch - begin_epoch).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_era - begin_era).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_segment - begin_segment).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_bounded - begin_bounded).count()),
              static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
     }
   }
 }
 
+/*
+ * 入队和出队都按 batch 个元素批量进行, batch 为 1 时退化为逐个 Push / Pop
+ */
+void batch_benchmark_test() {
+  for (int i : {1, 4, 10}) {
+    for (size_t batch : {1, 8, 64, 512}) {
+      auto begin_lock_free = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::Reclaimer>(i, i, 1000000, batch);
+      auto end_lock_free = std::chrono::steady_clock::now();
+
+      auto begin_epoch = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::EpochReclaimer>(i, i, 1000000, batch);
+      auto end_epoch = std::chrono::steady_clock::now();
+
+      printf("Producer(%2d), Consumer(%2d), Batch(%3lu), LockFree(%5lld ms), Epoch(%5lld ms)\n", i, i, batch,
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch - begin_epoch).count()));
+    }
+  }
+}
+
+// 一个生产者一个消费者
+void spsc_benchmark_test() {
+  for (size_t batch : {1, 8, 64, 512}) {
+    auto begin_spsc = std::chrono::steady_clock::now();
+    spsc_queue(1000000, batch);
+    auto end_spsc = std::chrono::steady_clock::now();
+
+    auto begin_lock_free = std::chrono::steady_clock::now();
+    lock_free_queue<lockFree::Reclaimer>(1, 1, 1000000, batch);
+    auto end_lock_free = std::chrono::steady_clock::now();
+
+    auto begin_block = std::chrono::steady_clock::now();
+    block_queue(1, 1, 1000000);
+    auto end_block = std::chrono::steady_clock::now();
+
+    printf("Batch(%3lu), Spsc(%5lld ms), LockFree(%5lld ms), Block(%5lld ms)\n", batch,
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_spsc - begin_spsc).count()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
+  }
+}
+
+// benchmark_test 中一个消费者的几行, 加上 MPSC 队列
+void mpsc_benchmark_test() {
+  for (int i = 1; i <= 10; i++) {
+    auto begin_mpsc = std::chrono::steady_clock::now();
+    mpsc_queue(i, 1000000);
+    auto end_mpsc = std::chrono::steady_clock::now();
+
+    auto begin_lock_free = std::chrono::steady_clock::now();
+    lock_free_queue<lockFree::Reclaimer>(i, 1, 1000000);
+    auto end_lock_free = std::chrono::steady_clock::now();
+
+    auto begin_segment = std::chrono::steady_clock::now();
+    segment_queue(i, 1, 1000000);
+    auto end_segment = std::chrono::steady_clock::now();
+
+    auto begin_block = std::chrono::steady_clock::now();
+    block_queue(i, 1, 1000000);
+    auto end_block = std::chrono::steady_clock::now();
+
+    printf("Producer(%2d), Consumer( 1), Mpsc(%5lld ms), LockFree(%5lld ms), Segment(%5lld ms), Block(%5lld ms)\n", i,
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_mpsc - begin_mpsc).count()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_segment - begin_segment).count()),
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
+  }
+}
+
+// 不同的松弛参数下的吞吐量和 rank error, LockFree 为严格 FIFO 的对照
+void multi_queue_benchmark_test() {
+  for (int i : {1, 4, 10}) {
+    auto begin_lock_free = std::chrono::steady_clock::now();
+    lock_free_queue<lockFree::Reclaimer>(i, i, 1000000);
+    auto end_lock_free = std::chrono::steady_clock::now();
+    printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms)\n", i, i,
+           static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()));
+    for (size_t factor : {1, 2, 4}) {
+      for (size_t stickiness : {1, 8, 64}) {
+        auto begin_multi = std::chrono::steady_clock::now();
+        multi_queue(i, i, 1000000, factor, stickiness);
+        auto end_multi = std::chrono::steady_clock::now();
+
+        double mean;
+        int64_t max;
+        rank_error(2 * i, 1000000, factor, stickiness, mean, max);
+
+        printf("Producer(%2d), Consumer(%2d), Factor(%lu), Stickiness(%2lu), Multi(%5lld ms), Rank error(mean %8.2f, max %6lld)\n",
+               i, i, factor, stickiness,
+               static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_multi - begin_multi).count()),
+               mean, static_cast<long long>(max));
+      }
+    }
+  }
+}
+
 int main() {
 //  basic_test();
 //  only_one_to_one();
 //  five_to_one();
 //  one_to_five();
 //  ten_to_ten();
+//  mpsc_test();
+//  own_domain_test();
+//  short_lived_threads_test(100, 8, 10000);
 
 //  benchmark_test();
+//  batch_benchmark_test();
+//  spsc_benchmark_test();
+//  mpsc_benchmark_test();
+//  multi_queue_benchmark_test();
+//  wait_test();
+//  latency_test();
+//  stalled_reader_test<lockFree::Reclaimer>("Hazard", 4, 500000);
+//  stalled_reader_test<lockFree::EpochReclaimer>("Epoch", 4, 500000);
+//  stalled_reader_test<lockFree::EraReclaimer>("Era", 4, 500000);
+//  for (size_t max_nodes : {0, 100000, 10000}) {
+//    bounded_memory_test(max_nodes, 4, 4, 500000);
+//  }
 
   auto begin_lock_free = std::chrono::steady_clock::now();
-  lock_free_queue(10, 10, 1000000);
+  lock_free_queue<lockFree::Reclaimer>(10, 10, 1000000);
   auto end_lock_free = std::chrono::steady_clock::now();
   std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count() << "\n";
   return 0;
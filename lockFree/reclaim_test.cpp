@@ -0,0 +1,105 @@
+#include <chrono>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+#include "reclaim.h"
+
+// 被回收的节点预先分配好, 删除函数为空操作, 只统计扫描本身的开销
+void NoopDelete(void *ptr, uintptr_t context) {}
+
+/*
+ * hazard_size 个 hazard 由 holder 持有, 其中一半指向已经退休的 pinned 节点, 每轮扫描都会被保留,
+ * scanner 每轮再退休 retire_size 个节点后执行一次 ReclaimNoHazard
+ */
+void scan_benchmark(size_t hazard_size, size_t retire_size, int rounds) {
+  lockFree::HazardDomain domain;
+  lockFree::Reclaimer holder(domain);
+  lockFree::Reclaimer scanner(domain);
+
+  std::vector<int> nodes(retire_size);
+  std::vector<int> pinned(hazard_size);
+  std::vector<int32_t> indexes;
+  for (size_t i = 0; i < hazard_size; i++) {
+    indexes.push_back(holder.MarkHazard(&pinned[i]));
+    if (i & 1) {
+      scanner.ReclaimLater(&pinned[i], NoopDelete);
+    }
+  }
+
+  int64_t total = 0;
+  for (int round = 0; round < rounds; round++) {
+    for (auto &it : nodes) {
+      scanner.ReclaimLater(&it, NoopDelete);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    scanner.ReclaimNoHazard();
+    auto end = std::chrono::steady_clock::now();
+    total += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+  }
+
+  for (auto it : indexes) {
+    holder.UnmarkHazard(it);
+  }
+
+  printf("Hazard(%5lu), Retire(%6lu), Scan(%9lld ns)\n", hazard_size, retire_size,
+         static_cast<int64_t>(total / rounds));
+}
+
+void benchmark_test() {
+  for (size_t hazard_size = 8; hazard_size <= 1024; hazard_size *= 4) {
+    for (size_t retire_size = hazard_size * 4; retire_size <= 65536; retire_size *= 4) {
+      scan_benchmark(hazard_size, retire_size, 100);
+    }
+  }
+}
+
+/*
+ * 多个线程退休节点的同时另一个线程不断读取统计快照, 需要定义 LOCKFREE_RECLAIM_STATS
+ */
+void stats_test(size_t threads, int limit) {
+  auto domain = std::make_shared<lockFree::HazardDomain>();
+  std::atomic<bool> stop{false};
+  uint64_t observed = 0;
+
+  auto monitor = std::thread([&domain, &stop, &observed]() {
+    while (!stop.load(std::memory_order_acquire)) {
+      observed = std::max(observed, domain->Stats().backlog_);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back([&domain, limit]() {
+      lockFree::Reclaimer reclaimer(*domain);
+      for (int i = 0; i < limit; i++) {
+        auto *node = new int(i);
+        lockFree::HazardPoint hp(&reclaimer, node);
+        reclaimer.Retire(node);
+        hp.Unmark();
+        reclaimer.ReclaimNoHazard();
+      }
+    });
+  }
+  for (auto &it : workers) {
+    it.join();
+  }
+  stop.store(true, std::memory_order_release);
+  monitor.join();
+
+  auto stats = domain->Stats();
+  printf("Retired(%8llu), Freed(%8llu), Scans(%6llu), Scan(%8llu us), Backlog(%5llu), Peak backlog(%5llu), "
+         "Observed backlog(%5llu), Hazard(%3lu / %3lu), Orphans(%5lu)\n",
+         static_cast<unsigned long long>(stats.retired_), static_cast<unsigned long long>(stats.freed_),
+         static_cast<unsigned long long>(stats.scans_), static_cast<unsigned long long>(stats.scan_ns_ / 1000),
+         static_cast<unsigned long long>(stats.backlog_), static_cast<unsigned long long>(stats.peak_backlog_),
+         static_cast<unsigned long long>(observed), stats.hazard_in_use_, stats.hazard_slots_, stats.orphans_);
+}
+
+int main() {
+  benchmark_test();
+//  stats_test(8, 100000);
+  return 0;
+}
@@ -1,98 +1,725 @@
-#include <unordered_set>
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
 
 #include "reclaim.h"
 
 namespace lockFree {
 
+namespace {
+
+// 注册当前进程使用 MEMBARRIER_CMD_PRIVATE_EXPEDITED, 只需要注册一次
+bool RegisterMembarrier() {
+#if defined(__linux__) && defined(__NR_membarrier)
+  static const bool registered = []() {
+    long commands = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+    if (commands < 0 || (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) == 0) {
+      return false;
+    }
+    return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+  }();
+  return registered;
+#else
+  return false;
+#endif
+}
+
+// 让进程内所有正在运行的线程执行一次 full fence, 只在注册成功之后调用
+void Membarrier() {
+#if defined(__linux__) && defined(__NR_membarrier)
+  if (syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0) {
+    return ;
+  }
+#endif
+  // 读线程只有编译器屏障, 本地 fence 不能代替, 继续扫描可能释放仍被保护的节点
+  std::abort();
+}
+
+}
+
+HazardDomain::HazardDomain(HazardFence fence) : HazardDomain(fence, ReclaimLimit()) {}
+
+HazardDomain::HazardDomain(HazardFence fence, const ReclaimLimit &limit)
+    : unreclaimed_nodes_(0), unreclaimed_bytes_(0),
+      fence_(fence == HazardFence::Asymmetric && RegisterMembarrier() ? HazardFence::Asymmetric
+                                                                        : HazardFence::Symmetric),
+      limit_(limit) {}
+
+HazardDomain::HazardDomain(HazardFence fence, const ReclaimServiceOptions &options, const ReclaimLimit &limit)
+    : HazardDomain(fence, limit) {
+  // 先赋值再启动, 后台线程构造 Reclaimer 时 service_ 已经就绪
+  service_ = std::make_unique<ReclaimService>(*this, options);
+  service_->Start();
+}
+
+ReclaimStats HazardDomain::Stats() {
+  ReclaimStats stats;
+  auto *c = directory_.counters_.load(std::memory_order_acquire);
+  while (c) {
+    stats.retired_ += c->retired_.load(std::memory_order_relaxed);
+    stats.freed_ += c->freed_.load(std::memory_order_relaxed);
+    stats.scans_ += c->scans_.load(std::memory_order_relaxed);
+    stats.scan_ns_ += c->scan_ns_.load(std::memory_order_relaxed);
+    stats.peak_backlog_ = std::max(stats.peak_backlog_, c->peak_backlog_.load(std::memory_order_relaxed));
+    c = c->next_.load(std::memory_order_acquire);
+  }
+  // 先读 freed 后读 retired 也不能保证一致, 这里只避免出现负数
+  stats.backlog_ = stats.retired_ > stats.freed_ ? stats.retired_ - stats.freed_ : 0;
+
+  stats.hazard_slots_ = directory_.Size();
+  auto *p = directory_.head_.load(std::memory_order_acquire);
+  while (p) {
+    for (auto &slot : p->slots_) {
+      if (slot.load(std::memory_order_relaxed) != nullptr) {
+        stats.hazard_in_use_++;
+      }
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+  stats.orphans_ = orphans_.Size();
+  return stats;
+}
+
+ReclaimService::ReclaimService(HazardDomain &domain, const ReclaimServiceOptions &options)
+    : domain_(domain), options_(options), notified_(false), stop_(false) {}
+
+ReclaimService::~ReclaimService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ReclaimService::Start() {
+  thread_ = std::thread(&ReclaimService::Run, this);
+}
+
+void ReclaimService::Push(std::vector<ReclaimPoint> &&nodes) {
+  pending_.Push(std::move(nodes));
+  if (pending_.Size() >= options_.wake_threshold_ && !notified_.exchange(true, std::memory_order_relaxed)) {
+    cv_.notify_one();
+  }
+}
+
+void ReclaimService::Run() {
+  Reclaimer reclaimer(domain_);
+  auto drain = [this, &reclaimer]() {
+    pending_.TakeAll(reclaimer.reclaim_list_);
+    domain_.orphans_.TakeAll(reclaimer.reclaim_list_);
+    if (!reclaimer.reclaim_list_.empty()) {
+      reclaimer.Scan();
+    }
+  };
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    cv_.wait_for(lock, options_.interval_, [this]() {
+      return stop_ || notified_.load(std::memory_order_relaxed);
+    });
+    notified_.store(false, std::memory_order_relaxed);
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+  lock.unlock();
+  // 仍被标记的节点在 reclaimer 析构时交给 orphans_, 由 domain 析构时删除
+  drain();
+}
+
+OrphanList::~OrphanList() {
+  auto *p = head_.exchange(nullptr, std::memory_order_acquire);
+  while (p) {
+    for (auto &it : p->nodes_) {
+      it.Reclaim();
+    }
+    auto temp = p;
+    p = p->next_;
+    delete temp;
+  }
+}
+
+void OrphanList::Push(std::vector<ReclaimPoint> &&nodes) {
+  auto size = nodes.size();
+  auto *batch = new Batch(std::move(nodes));
+  Batch *old_head = head_.load(std::memory_order_relaxed);
+  do {
+    batch->next_ = old_head;
+  } while (!head_.compare_exchange_weak(old_head, batch, std::memory_order_release, std::memory_order_relaxed));
+  size_.fetch_add(size, std::memory_order_relaxed);
+}
+
+bool OrphanList::TakeAll(std::vector<ReclaimPoint> &nodes) {
+  // 一次取走整个链表, 不存在 ABA 问题
+  if (head_.load(std::memory_order_relaxed) == nullptr) {
+    return false;
+  }
+  auto *p = head_.exchange(nullptr, std::memory_order_acquire);
+  if (p == nullptr) {
+    return false;
+  }
+  while (p) {
+    size_.fetch_sub(p->nodes_.size(), std::memory_order_relaxed);
+    nodes.insert(nodes.end(), p->nodes_.begin(), p->nodes_.end());
+    auto temp = p;
+    p = p->next_;
+    delete temp;
+  }
+  return true;
+}
+
+Reclaimer::~Reclaimer() {
+  // 将当前持有的 block 归还到 directory
+#ifndef NDEBUG
+  for (auto *it : local_slots_) {
+    assert(it->load(std::memory_order_acquire) == nullptr);
+  }
+#endif
+  for (auto *it : local_blocks_) {
+    it->flag_.clear(std::memory_order_release);
+  }
+  Scan();
+  if (!reclaim_list_.empty()) {
+    domain_.orphans_.Push(std::move(reclaim_list_));
+  }
+  if (counter_ != nullptr) {
+    counter_->flag_.clear(std::memory_order_release);
+  }
+}
+
 int32_t Reclaimer::MarkHazard(void *ptr) {
   if (ptr == nullptr) {
     return -1;
   }
-  // 先从 local_hp_list_ 找，这里的保证不会有线程竞争
-  int32_t res_index = 0;
-  for (auto *it : local_hp_list_) {
-    if (it->ptr_.load(std::memory_order_relaxed) == nullptr) {
-      it->ptr_.store(ptr, std::memory_order_release);
-      return res_index;
-    }
-    res_index++;
+  if (free_slots_.empty()) {
+    RequireHazardBlock();
+  }
+  auto index = free_slots_.back();
+  free_slots_.pop_back();
+  local_slots_[index]->store(ptr, std::memory_order_relaxed);
+  // 之后对源指针的重新读取不能早于 hazard 的发布
+  if (asymmetric_) {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  } else {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
   }
-  RequireHazardPoint();
-  res_index = static_cast<int32_t>(local_hp_list_.size()) - 1;
-  local_hp_list_[res_index]->ptr_.store(ptr, std::memory_order_release);
-  return res_index;
+  return index;
 }
 
 void Reclaimer::UnmarkHazard(int32_t index) {
-  assert(0 <= index && index < local_hp_list_.size());
-  local_hp_list_[index]->ptr_.store(nullptr, std::memory_order_release);
+  assert(0 <= index && static_cast<size_t>(index) < local_slots_.size());
+  local_slots_[index]->store(nullptr, std::memory_order_release);
+  free_slots_.push_back(index);
 }
 
-void Reclaimer::ReclaimLater(void *ptr, std::function<void(void *)> &&delete_function){
-  auto reclaimPoint = reclaim_pool_.Pop();
-  reclaimPoint->ptr_ = ptr;
-  reclaimPoint->delete_function_ = std::move(delete_function);
-
-  reclaim_map_.insert(std::make_pair(ptr, reclaimPoint));
+void Reclaimer::ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context, size_t size) {
+  reclaim_list_.emplace_back(ptr, delete_function, context, size);
+  if (limited_) {
+    domain_.unreclaimed_nodes_.fetch_add(1, std::memory_order_relaxed);
+    domain_.unreclaimed_bytes_.fetch_add(size, std::memory_order_relaxed);
+  }
+  if constexpr (ReclaimStatsEnabled) {
+    ReclaimCounter::Add(counter_->retired_, 1);
+    ReclaimCounter::Max(counter_->peak_backlog_, reclaim_list_.size());
+  }
 }
 
 void Reclaimer::ReclaimNoHazard() {
-  if (reclaim_map_.size() < std::max(rate_ * global_hp_list_.Size(), static_cast<size_t>(10))) {
+  if (limited_ && domain_.OverLimit()) {
+    Backpressure();
     return ;
   }
-  std::unordered_set<void*> can_not_delete_set;
-  auto p = global_hp_list_.head_.load(std::memory_order_acquire);
+  if (service_ != nullptr) {
+    if (reclaim_list_.size() >= service_->BatchSize()) {
+      service_->Push(std::move(reclaim_list_));
+      reclaim_list_.clear();
+    }
+    return ;
+  }
+  domain_.orphans_.TakeAll(reclaim_list_);
+  if (reclaim_list_.size() < std::max(rate_ * directory_.Size(), static_cast<size_t>(10))) {
+    return ;
+  }
+  Scan();
+}
+
+void Reclaimer::Scan() {
+  std::chrono::steady_clock::time_point begin;
+  if constexpr (ReclaimStatsEnabled) {
+    begin = std::chrono::steady_clock::now();
+  }
+  hazard_snapshot_.clear();
+  // 读线程只有编译器屏障, 由扫描线程替所有线程执行 full fence
+  if (asymmetric_) {
+    Membarrier();
+  } else {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  // 逐个 block 线性扫描槽位, 最后用一次 acquire fence 代替每个槽位的 acquire load
+  auto p = directory_.head_.load(std::memory_order_acquire);
+  while (p) {
+    for (auto &slot : p->slots_) {
+      void* const ptr = slot.load(std::memory_order_relaxed);
+      if (ptr != nullptr) {
+        hazard_snapshot_.push_back(ptr);
+      }
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  std::sort(hazard_snapshot_.begin(), hazard_snapshot_.end());
+
+  // 仍被标记为 hazard 的节点移动到前面, 其余节点删除
+  auto mid = std::partition(reclaim_list_.begin(), reclaim_list_.end(), [this](const ReclaimPoint &point) {
+    return std::binary_search(hazard_snapshot_.begin(), hazard_snapshot_.end(), point.ptr_);
+  });
+  size_t freed_bytes = 0;
+  for (auto it = mid; it != reclaim_list_.end(); it++) {
+    freed_bytes += it->size_;
+    it->Reclaim();
+  }
+  if (limited_) {
+    domain_.unreclaimed_nodes_.fetch_sub(reclaim_list_.end() - mid, std::memory_order_relaxed);
+    domain_.unreclaimed_bytes_.fetch_sub(freed_bytes, std::memory_order_relaxed);
+  }
+  if constexpr (ReclaimStatsEnabled) {
+    ReclaimCounter::Add(counter_->freed_, reclaim_list_.end() - mid);
+    ReclaimCounter::Add(counter_->scans_, 1);
+    ReclaimCounter::Add(counter_->scan_ns_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count());
+  }
+  reclaim_list_.erase(mid, reclaim_list_.end());
+}
+
+void Reclaimer::RequireHazardBlock() {
+  // 先复用已经退出的线程归还的 block
+  auto p = directory_.head_.load(std::memory_order_acquire);
   while (p) {
-    void* const ptr = p->ptr_.load(std::memory_order_acquire);
-    if (ptr != nullptr) {
-      can_not_delete_set.insert(ptr);
+    if (!p->flag_.test_and_set()) {
+      break;
     }
     p = p->next_.load(std::memory_order_acquire);
   }
 
-  for (auto it = reclaim_map_.begin(); it != reclaim_map_.end(); ) {
-    if (can_not_delete_set.find(it->second->ptr_) != can_not_delete_set.end()) {
-      it++;
-      continue ;
+  // 否则只能 new 一个了
+  if (p == nullptr) {
+    p = new HazardBlock();
+    p->flag_.test_and_set();
+    HazardBlock *old_head;
+    do {
+      old_head = directory_.head_.load(std::memory_order_acquire);
+      p->next_ = old_head;
+    } while (!directory_.head_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
+    directory_.size_.fetch_add(HazardBlockSlots, std::memory_order_relaxed);
+  }
+
+  local_blocks_.push_back(p);
+  // 倒序压入, 优先使用下标小的槽位
+  auto base = static_cast<int32_t>(local_slots_.size());
+  for (auto &slot : p->slots_) {
+    local_slots_.push_back(&slot);
+  }
+  for (auto i = static_cast<int32_t>(HazardBlockSlots) - 1; i >= 0; i--) {
+    free_slots_.push_back(base + i);
+  }
+}
+
+void Reclaimer::Backpressure() {
+  const auto &limit = domain_.Limit();
+  auto deadline = std::chrono::steady_clock::now() + limit.max_wait_;
+  for (uint32_t attempt = 0; ; attempt++) {
+    // 不再等待攒够一批, 连同孤儿节点和后台线程尚未处理的节点一起立即扫描
+    domain_.orphans_.TakeAll(reclaim_list_);
+    if (service_ != nullptr) {
+      service_->TakeAll(reclaim_list_);
+    }
+    Scan();
+    if (!domain_.OverLimit()) {
+      return ;
+    }
+    if (limit.callback_ != nullptr) {
+      limit.callback_(limit.callback_context_, domain_.UnreclaimedNodes(), domain_.UnreclaimedBytes(), attempt);
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return ;
+    }
+    // 前几次只让出 CPU, 之后 sleep 的时间指数增长, 不超过剩余的等待时间
+    if (attempt < 4) {
+      std::this_thread::yield();
+    } else {
+      auto wait = std::chrono::microseconds(1LL << std::min<uint32_t>(attempt - 4, 10));
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(wait, deadline - now));
     }
-    it->second->delete_function_(it->second->ptr_);
-    reclaim_pool_.Push(it->second);
-    it = reclaim_map_.erase(it);
   }
 }
 
-void Reclaimer::RequireHazardPoint() {
-  // 先从global中获取
-  auto p = global_hp_list_.head_.load(std::memory_order_acquire);
+void Reclaimer::RequireCounter() {
+  // 复用已经退出的线程归还的 counter, 计数继续累加
+  auto p = directory_.counters_.load(std::memory_order_acquire);
   while (p) {
     if (!p->flag_.test_and_set()) {
-      local_hp_list_.emplace_back(p);
+      counter_ = p;
       return ;
     }
     p = p->next_.load(std::memory_order_acquire);
   }
 
-  // 否则只能 new 一个了
-  p = new InternalHazardPoint();
+  p = new ReclaimCounter();
   p->flag_.test_and_set();
-  InternalHazardPoint *old_head;
+  ReclaimCounter *old_head;
   do {
-    old_head = global_hp_list_.head_.load(std::memory_order_acquire);
+    old_head = directory_.counters_.load(std::memory_order_acquire);
     p->next_ = old_head;
-  } while (!global_hp_list_.head_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
-  global_hp_list_.size_.fetch_add(1, std::memory_order::relaxed);
-  local_hp_list_.emplace_back(p);
+  } while (!directory_.counters_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
+  counter_ = p;
+}
+
+EpochReclaimer::EpochReclaimer(EpochDomain &domain)
+    : domain_(domain), record_(nullptr), depth_(0),
+      limbo_epoch_{0, 0, 0}, limbo_size_(0) {
+  RequireEpochRecord();
+}
+
+EpochReclaimer::~EpochReclaimer() {
+  assert(depth_ == 0);
+  // 归还 epoch record
+  record_->epoch_.store(0, std::memory_order_release);
+  record_->flag_.clear(std::memory_order_release);
+  // 推进一次 epoch, 仍然不能删除的节点交给 domain, 不会阻塞线程退出
+  TryAdvance();
+  ReclaimBefore(domain_.epoch_.load(std::memory_order_acquire));
+  if (limbo_size_ != 0) {
+    std::vector<ReclaimPoint> nodes;
+    nodes.reserve(limbo_size_);
+    for (auto &it : limbo_) {
+      nodes.insert(nodes.end(), it.begin(), it.end());
+    }
+    domain_.orphans_.Push(std::move(nodes));
+  }
+}
+
+void EpochReclaimer::Enter() {
+  if (depth_++ != 0) {
+    return ;
+  }
+  auto epoch = domain_.epoch_.load(std::memory_order_acquire);
+  // seq_cst 保证在之后读取共享节点之前, 其他线程可以观察到当前线程进入了临界区
+  record_->epoch_.store((epoch << 1) | 1, std::memory_order_seq_cst);
 }
 
-bool Reclaimer::Hazard(void *ptr) {
-  auto p = global_hp_list_.head_.load(std::memory_order_acquire);
+void EpochReclaimer::Exit() {
+  assert(depth_ > 0);
+  if (--depth_ != 0) {
+    return ;
+  }
+  record_->epoch_.store(0, std::memory_order_release);
+}
+
+void EpochReclaimer::ReclaimLater(void *ptr, DeleteFunction delete_function, uintptr_t context, size_t size) {
+  auto epoch = domain_.epoch_.load(std::memory_order_seq_cst);
+  auto index = epoch % 3;
+  // 同一个桶中的节点最晚在 epoch - 3 退休, 已经可以安全删除
+  if (limbo_epoch_[index] != epoch) {
+    FreeLimbo(index);
+    limbo_epoch_[index] = epoch;
+  }
+  limbo_[index].emplace_back(ptr, delete_function, context, size);
+  limbo_size_++;
+}
+
+void EpochReclaimer::ReclaimNoHazard() {
+  AdoptOrphans();
+  if (limbo_size_ < threshold_) {
+    return ;
+  }
+  TryAdvance();
+  ReclaimBefore(domain_.epoch_.load(std::memory_order_acquire));
+}
+
+bool EpochReclaimer::TryAdvance() {
+  auto epoch = domain_.epoch_.load(std::memory_order_seq_cst);
+  auto p = domain_.head_.load(std::memory_order_acquire);
   while (p) {
-    if (p->ptr_.load(std::memory_order_acquire) == ptr) {
-      return true;
+    auto local = p->epoch_.load(std::memory_order_seq_cst);
+    if (EpochRecord::Active(local) && (local >> 1) != epoch) {
+      return false;
     }
     p = p->next_.load(std::memory_order_acquire);
   }
-  return false;
+  return domain_.epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+void EpochReclaimer::ReclaimBefore(uint64_t epoch) {
+  for (size_t i = 0; i < 3; i++) {
+    if (!limbo_[i].empty() && limbo_epoch_[i] + 2 <= epoch) {
+      FreeLimbo(i);
+    }
+  }
+}
+
+void EpochReclaimer::FreeLimbo(size_t index) {
+  for (auto &it : limbo_[index]) {
+    it.Reclaim();
+  }
+  limbo_size_ -= limbo_[index].size();
+  limbo_[index].clear();
+}
+
+void EpochReclaimer::AdoptOrphans() {
+  // 接管的节点退休时间不晚于当前 epoch, 按当前 epoch 重新退休是安全的
+  if (!domain_.orphans_.TakeAll(adopted_)) {
+    return ;
+  }
+  for (auto &it : adopted_) {
+    ReclaimLater(it.ptr_, it.delete_function_, it.context_, it.size_);
+  }
+  adopted_.clear();
+}
+
+void EpochReclaimer::RequireEpochRecord() {
+  // 先复用已经退出的线程留下的 record
+  auto p = domain_.head_.load(std::memory_order_acquire);
+  while (p) {
+    if (!p->flag_.test_and_set()) {
+      record_ = p;
+      return ;
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+
+  p = new EpochRecord();
+  p->flag_.test_and_set();
+  EpochRecord *old_head;
+  do {
+    old_head = domain_.head_.load(std::memory_order_acquire);
+    p->next_ = old_head;
+  } while (!domain_.head_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
+  domain_.size_.fetch_add(1, std::memory_order_relaxed);
+  record_ = p;
+}
+
+EraReclaimer::EraReclaimer(EraDomain &domain) : domain_(domain), depth_(0), pinned_(0) {}
+
+EraReclaimer::~EraReclaimer() {
+  assert(depth_ == 0);
+#ifndef NDEBUG
+  for (auto *it : local_slots_) {
+    assert(it->load(std::memory_order_acquire) == NoneEra);
+  }
+#endif
+  for (auto *it : local_blocks_) {
+    it->flag_.clear(std::memory_order_release);
+  }
+  Scan();
+  if (!reclaim_list_.empty()) {
+    // 交给 orphan list 之后丢失 era 信息, 接管的线程按 [0, 当时的 era] 处理, 只会更保守
+    std::vector<ReclaimPoint> nodes;
+    nodes.reserve(reclaim_list_.size());
+    for (auto &it : reclaim_list_) {
+      nodes.push_back(it.point_);
+    }
+    domain_.orphans_.Push(std::move(nodes));
+  }
+}
+
+void EraReclaimer::Exit() {
+  assert(depth_ > 0);
+  if (--depth_ != 0) {
+    return ;
+  }
+  for (auto *it : local_slots_) {
+    if (it->load(std::memory_order_relaxed) != NoneEra) {
+      it->store(NoneEra, std::memory_order_release);
+    }
+  }
+}
+
+void EraReclaimer::RetireEra(const ReclaimPoint &point, uint64_t birth) {
+  // retire era 需要在节点从数据结构中摘除之后读取
+  auto retire = domain_.clock_.load(std::memory_order_seq_cst);
+  reclaim_list_.emplace_back(point, birth, retire);
+}
+
+void EraReclaimer::ReclaimNoHazard() {
+  // 接管的节点 birth 未知, 退休时间不晚于当前 era
+  if (domain_.orphans_.TakeAll(adopted_)) {
+    auto retire = domain_.clock_.load(std::memory_order_seq_cst);
+    for (auto &it : adopted_) {
+      reclaim_list_.emplace_back(it, NoneEra, retire);
+    }
+    adopted_.clear();
+  }
+  // 上一次扫描后仍不能删除的节点不计入阈值, 避免读线程很活跃时每次都扫描却删除不了节点
+  if (reclaim_list_.size() < pinned_ + std::max(rate_ * domain_.Size(), static_cast<size_t>(10))) {
+    return ;
+  }
+  Scan();
+}
+
+void EraReclaimer::Scan() {
+  era_snapshot_.clear();
+  // 推进全局 era, 之后开始的操作发布新的 era, 不会再保护已经退休的节点
+  domain_.clock_.fetch_add(1, std::memory_order_seq_cst);
+  // 与 PublishEra 中发布之后的 fence 配对, RMW 本身不能保证之后的 relaxed 读取看到读线程已经发布的 era
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto p = domain_.head_.load(std::memory_order_acquire);
+  while (p) {
+    for (auto &slot : p->slots_) {
+      auto era = slot.load(std::memory_order_relaxed);
+      if (era != NoneEra) {
+        era_snapshot_.push_back(era);
+      }
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  std::sort(era_snapshot_.begin(), era_snapshot_.end());
+
+  // 存在发布的 era 落在 [birth, retire] 之间的节点移动到前面, 其余节点删除
+  auto mid = std::partition(reclaim_list_.begin(), reclaim_list_.end(), [this](const Retired &retired) {
+    auto it = std::lower_bound(era_snapshot_.begin(), era_snapshot_.end(), retired.birth_);
+    return it != era_snapshot_.end() && *it <= retired.retire_;
+  });
+  for (auto it = mid; it != reclaim_list_.end(); it++) {
+    it->point_.Reclaim();
+  }
+  reclaim_list_.erase(mid, reclaim_list_.end());
+  pinned_ = reclaim_list_.size();
+}
+
+void EraReclaimer::RequireEraBlock() {
+  auto p = domain_.head_.load(std::memory_order_acquire);
+  while (p) {
+    if (!p->flag_.test_and_set()) {
+      break;
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+
+  if (p == nullptr) {
+    p = new EraBlock();
+    p->flag_.test_and_set();
+    EraBlock *old_head;
+    do {
+      old_head = domain_.head_.load(std::memory_order_acquire);
+      p->next_ = old_head;
+    } while (!domain_.head_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
+    domain_.size_.fetch_add(EraBlockSlots, std::memory_order_relaxed);
+  }
+
+  local_blocks_.push_back(p);
+  auto base = static_cast<int32_t>(local_slots_.size());
+  for (auto &slot : p->slots_) {
+    local_slots_.push_back(&slot);
+  }
+  for (auto i = static_cast<int32_t>(EraBlockSlots) - 1; i >= 0; i--) {
+    free_slots_.push_back(base + i);
+  }
+}
+
+QsbrReclaimer::QsbrReclaimer(QsbrDomain &domain) : domain_(domain), record_(nullptr), online_(false) {
+  RequireQsbrRecord();
+}
+
+QsbrReclaimer::~QsbrReclaimer() {
+  Offline();
+  record_->flag_.clear(std::memory_order_release);
+  if (!pending_.empty()) {
+    batches_.emplace_back(domain_.epoch_.fetch_add(1, std::memory_order_seq_cst) + 1, std::move(pending_));
+  }
+  FreeBatches(MinQuiescent());
+  // 仍然不能删除的节点交给 domain, 不会阻塞线程退出
+  std::vector<ReclaimPoint> nodes;
+  for (auto &it : batches_) {
+    nodes.insert(nodes.end(), it.nodes_.begin(), it.nodes_.end());
+  }
+  if (!nodes.empty()) {
+    domain_.orphans_.Push(std::move(nodes));
+  }
+}
+
+void QsbrReclaimer::Online() {
+  // seq_cst 保证在之后读取共享节点之前, 其他线程可以观察到当前线程已经上线
+  record_->quiescent_.store(domain_.epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+  online_ = true;
+}
+
+void QsbrReclaimer::Offline() {
+  record_->quiescent_.store(QsbrRecord::Offline, std::memory_order_release);
+  online_ = false;
+}
+
+void QsbrReclaimer::ReclaimNoHazard() {
+  domain_.orphans_.TakeAll(pending_);
+  if (pending_.size() < threshold_) {
+    return ;
+  }
+  // 之前退休的节点都已经从数据结构中摘除, 之后宣告静止的线程不可能再持有它们
+  auto epoch = domain_.epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+  batches_.emplace_back(epoch, std::move(pending_));
+  pending_.clear();
+  FreeBatches(MinQuiescent());
+}
+
+uint64_t QsbrReclaimer::MinQuiescent() {
+  auto result = QsbrRecord::Offline;
+  auto p = domain_.head_.load(std::memory_order_acquire);
+  while (p) {
+    result = std::min(result, p->quiescent_.load(std::memory_order_seq_cst));
+    p = p->next_.load(std::memory_order_acquire);
+  }
+  return result;
+}
+
+void QsbrReclaimer::FreeBatches(uint64_t safe_epoch) {
+  auto it = batches_.begin();
+  for (; it != batches_.end() && it->epoch_ <= safe_epoch; it++) {
+    for (auto &node : it->nodes_) {
+      node.Reclaim();
+    }
+  }
+  batches_.erase(batches_.begin(), it);
+}
+
+void QsbrReclaimer::RequireQsbrRecord() {
+  auto p = domain_.head_.load(std::memory_order_acquire);
+  while (p) {
+    if (!p->flag_.test_and_set()) {
+      record_ = p;
+      return ;
+    }
+    p = p->next_.load(std::memory_order_acquire);
+  }
+
+  p = new QsbrRecord();
+  p->flag_.test_and_set();
+  QsbrRecord *old_head;
+  do {
+    old_head = domain_.head_.load(std::memory_order_acquire);
+    p->next_ = old_head;
+  } while (!domain_.head_.compare_exchange_strong(old_head, p, std::memory_order_acq_rel));
+  domain_.size_.fetch_add(1, std::memory_order_relaxed);
+  record_ = p;
+}
+
+void QsbrQuiescent() {
+  ReclaimerRegistry<QsbrReclaimer>::ForEach([](QsbrReclaimer &reclaimer) {
+    reclaimer.Quiescent();
+  });
+}
+
+void QsbrOffline() {
+  ReclaimerRegistry<QsbrReclaimer>::ForEach([](QsbrReclaimer &reclaimer) {
+    reclaimer.Offline();
+  });
 }
 
 }
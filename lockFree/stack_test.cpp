@@ -4,6 +4,7 @@
 
 #include "reclaim.h"
 #include "lockFreeStack.h"
+#include "eliminationStack.h"
 #include "block.h"
 
 void basic_test() {
@@ -169,15 +170,78 @@ void ten_to_ten() {
   std::cout << lockFree::LockFreeStack<std::string>::Global_Size() << "\n";
 }
 
-void lock_free_queue(size_t producer, size_t consumer, int limit) {
+/*
+ * 每个线程交替入栈和出栈, 出栈释放的节点地址马上被下一次入栈复用, 消除数组的槽中会反复出现相同的地址
+ * 奇数线程使用 PushBulk / PopBulk, 与消除数组混用; 最后检查每个元素恰好出栈一次
+ */
+void elimination_test() {
+  lockFree::EliminationStack<int> q;
+  constexpr int thread_count = 8;
+  constexpr int limit = 100000;
+  constexpr int batch = 4;
+  std::vector<std::atomic<int>> seen(thread_count * limit);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&q, &seen, t]() {
+      int value;
+      if (t & 1) {
+        std::vector<int> items(batch);
+        std::vector<int> values(batch);
+        for (int i = 0; i < limit; i += batch) {
+          for (int j = 0; j < batch; j++) {
+            items[j] = t * limit + i + j;
+          }
+          q.PushBulk(items.begin(), items.end());
+          for (size_t count = 0; count < batch; ) {
+            auto n = q.PopBulk(values.begin(), batch - count);
+            for (size_t j = 0; j < n; j++) {
+              seen[values[j]].fetch_add(1, std::memory_order_relaxed);
+            }
+            count += n;
+          }
+        }
+        return ;
+      }
+      for (int i = 0; i < limit; i++) {
+        q.Push(t * limit + i);
+        q.PopWait(value);
+        seen[value].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  for (auto &it : threads) {
+    it.join();
+  }
+
+  int value;
+  assert(!q.Pop(value));
+  assert(q.Size() == 0);
+  for (auto &it : seen) {
+    assert(it.load(std::memory_order_relaxed) == 1);
+  }
+  std::cout << "Elimination OK, width " << q.Width() << "\n";
+}
+
+template<typename S>
+void lock_free_queue(size_t producer, size_t consumer, int limit, size_t batch = 1) {
   std::vector<std::thread> producers;
   std::vector<std::thread> consumers;
 
-  lockFree::LockFreeStack<std::string> q;
+  S q;
 
   for (auto i = 0; i < producer; i++) {
-    producers.emplace_back([&q, limit]() {
+    producers.emplace_back([&q, limit, batch]() {
       std::string str = "lifehappy";
+      if (batch > 1) {
+        std::vector<std::string> items(batch, str);
+        for (int i = 0; i < limit; i += static_cast<int>(batch)) {
+          auto size = std::min<size_t>(batch, limit - i);
+          q.PushBulk(items.begin(), items.begin() + static_cast<int64_t>(size));
+        }
+        return ;
+      }
       for (int i = 0; i < limit; i++) {
         if (i & 1) {
           q.Push(str);
@@ -191,7 +255,14 @@ void lock_free_queue(size_t producer, size_t consumer, int limit) {
   int need = limit * static_cast<int>(producer) / static_cast<int>(consumer);
 
   for (auto i = 0; i < consumer; i++) {
-    consumers.emplace_back([&q, limit = need]() {
+    consumers.emplace_back([&q, limit = need, batch]() {
+      if (batch > 1) {
+        std::vector<std::string> values(batch);
+        for (int i = 0; i < limit; ) {
+          i += static_cast<int>(q.PopBulk(values.begin(), std::min<size_t>(batch, limit - i)));
+        }
+        return ;
+      }
       std::string value;
       for (int i = 0; i < limit; i++) {
         while (!q.Pop(value));
@@ -248,27 +319,66 @@ void benchmark_test() {
   for (int i = 1; i <= 10; i++) {
     for (int j = 1; j <= 10; j++) {
       auto begin_lock_free = std::chrono::steady_clock::now();
-      lock_free_queue(i, j, 1000000);
+      lock_free_queue<lockFree::LockFreeStack<std::string>>(i, j, 1000000);
       auto end_lock_free = std::chrono::steady_clock::now();
 
+      auto begin_epoch = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::LockFreeStack<std::string, lockFree::EpochReclaimer>>(i, j, 1000000);
+      auto end_epoch = std::chrono::steady_clock::now();
+
+      auto begin_era = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::LockFreeStack<std::string, lockFree::EraReclaimer>>(i, j, 1000000);
+      auto end_era = std::chrono::steady_clock::now();
+
+      auto begin_elimination = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::EliminationStack<std::string>>(i, j, 1000000);
+      auto end_elimination = std::chrono::steady_clock::now();
+
+
       auto begin_block = std::chrono::steady_clock::now();
       block_queue(i, j, 1000000);
       auto end_block = std::chrono::steady_clock::now();
 
-      printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms), Block(%5lld ms)\n", i, j,
+      printf("Producer(%2d), Consumer(%2d), LockFree(%5lld ms), Epoch(%5lld ms), Era(%5lld ms), Elimination(%5lld ms), Block(%5lld ms)\n", i, j,
              static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch - begin_epoch).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_era - begin_era).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_elimination - begin_elimination).count()),
              static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_block - begin_block).count()));
     }
   }
 }
 
+/*
+ * 入队和出队都按 batch 个元素批量进行, batch 为 1 时退化为逐个 Push / Pop
+ */
+void batch_benchmark_test() {
+  for (int i : {1, 4, 10}) {
+    for (size_t batch : {1, 8, 64, 512}) {
+      auto begin_lock_free = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::LockFreeStack<std::string>>(i, i, 1000000, batch);
+      auto end_lock_free = std::chrono::steady_clock::now();
+
+      auto begin_epoch = std::chrono::steady_clock::now();
+      lock_free_queue<lockFree::LockFreeStack<std::string, lockFree::EpochReclaimer>>(i, i, 1000000, batch);
+      auto end_epoch = std::chrono::steady_clock::now();
+
+      printf("Producer(%2d), Consumer(%2d), Batch(%3lu), LockFree(%5lld ms), Epoch(%5lld ms)\n", i, i, batch,
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_lock_free - begin_lock_free).count()),
+             static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(end_epoch - begin_epoch).count()));
+    }
+  }
+}
+
 int main() {
 //  basic_test();
 //  only_one_to_one();
 //  five_to_one();
 //  one_to_five();
 //  ten_to_ten();
+//  elimination_test();
 
   benchmark_test();
+//  batch_benchmark_test();
   return 0;
 }
@@ -5,6 +5,7 @@
 #include <type_traits>
 #include <future>
 #include <queue>
+#include <functional>
 
 namespace threadPool {
 
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "threadPool.h"
+#include "lockFreeHashTable.h"
 
 int calc_primes(int n) {
   int cnt = 0;
@@ -20,6 +21,61 @@ int calc_primes(int n) {
   return cnt;
 }
 
+/*
+ * 线程池中的任务查询同一个哈希表, 每 update_every 个任务中有一个任务删除并重新插入一部分 key,
+ * 比较 hazard pointer 和由线程池在任务之间宣告静止的 QSBR
+ */
+template<typename R>
+int64_t hash_lookup_benchmark(size_t pool_size, int tasks, int lookups, int keys, int update_every) {
+  lockFree::LockFreeHashTable<int, int, R> table;
+  for (int i = 0; i < keys; i++) {
+    table.Insert(i, i);
+  }
+  // 主线程填充之后处于在线状态, 不下线会让 QSBR 在整个测试期间都无法删除节点
+  lockFree::QsbrOffline();
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    auto pool = threadPool::threadPool(pool_size);
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < tasks; i++) {
+      if (i % update_every == 0) {
+        results.emplace_back(pool.push([&table, lookups, keys](int seed) {
+          for (int j = 0; j < lookups / 10; j++) {
+            int key = (seed + j * 7919) % keys;
+            table.Delete(key);
+            table.Insert(key, key);
+          }
+          return 0;
+        }, i));
+      } else {
+        results.emplace_back(pool.push([&table, lookups, keys](int seed) {
+          int found = 0;
+          int value;
+          for (int j = 0; j < lookups; j++) {
+            found += table.Find((seed + j * 7919) % keys, value);
+          }
+          return found;
+        }, i));
+      }
+    }
+    for (auto &it : results) {
+      it.get();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+}
+
+void hash_lookup_test() {
+  for (size_t pool_size : {1, 2, 4, 8}) {
+    auto hazard = hash_lookup_benchmark<lockFree::Reclaimer>(pool_size, 20000, 1000, 100000, 20);
+    auto qsbr = hash_lookup_benchmark<lockFree::QsbrReclaimer>(pool_size, 20000, 1000, 100000, 20);
+    printf("Pool(%2lu), Hazard(%5lld ms), QSBR(%5lld ms)\n", pool_size,
+           static_cast<long long>(hazard), static_cast<long long>(qsbr));
+  }
+}
+
 int main() {
   auto pool = threadPool::threadPool(std::thread::hardware_concurrency());
   std::vector<std::future<int>> results;
@@ -34,5 +90,7 @@ int main() {
   auto end = std::chrono::steady_clock::now();
   auto time1 = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
   std::cout << time1.count() << " " << sum << "\n";
+
+//  hash_lookup_test();
   return 0;
 }
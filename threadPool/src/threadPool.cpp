@@ -4,6 +4,7 @@
 #include <queue>
 
 #include "threadPool.h"
+#include "reclaim.h"
 
 namespace threadPool {
 
@@ -15,6 +16,8 @@ threadPool::threadPool(size_t pool_size) : pool_size_(pool_size) {
         {
           std::unique_lock<std::mutex> lock(mutex_);
           while (!stop_ && tasks_.empty()) {
+            // 空闲期间不阻止 QSBR domain 回收节点
+            lockFree::QsbrOffline();
             cv_.wait(lock);
           }
           if (stop_) {
@@ -24,6 +27,8 @@ threadPool::threadPool(size_t pool_size) : pool_size_(pool_size) {
           tasks_.pop();
         }
         task();
+        // 任务之间不持有任何无锁容器的节点
+        lockFree::QsbrQuiescent();
       }
     });
   }